@@ -0,0 +1,72 @@
+#ifndef __FAULT_ARCH_H_
+#define __FAULT_ARCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fault_handler.h"
+
+/**
+ * \file
+ * \brief Core architecture backend of the handler
+ *
+ * Everything that differs between the fault models of the Cortex-M cores:
+ * which status registers exist, how they are cleared, where the stacked
+ * frame is and what keeps retained RAM valid across a reset.
+ * src/fault_arch_v6m.c implements it for ARMv6-M and ARMv8-M Baseline,
+ * src/fault_arch_v7m.c for ARMv7-M and ARMv8-M Mainline; the one matching
+ * #FAULT_HANDLER_ARCH is built. All but fault_arch_init() runs inside the
+ * fault handler.
+ */
+
+/**
+ * \brief Prepare the core at boot, from fault_handler_boot_check()
+ *
+ * On ARMv8-M Mainline stack limit checks are ignored at negative priority
+ * (CCR.STKOFHFNMIGN), so HardFault can run on a MSP already at its limit.
+ */
+void fault_arch_init(void);
+
+/** \brief CFSR, 0 on cores without it */
+uint32_t fault_arch_cfsr(void);
+
+/** \brief HFSR, 0 on cores without it */
+uint32_t fault_arch_hfsr(void);
+
+/**
+ * \brief Fill the status fields of \p rec other than cfsr and hfsr
+ *
+ * mmfar, bfar, afsr and shcsr, and on ARMv8-M Mainline sfsr, sfar, msplim
+ * and psplim with #FAULT_FLAG_V8M.
+ */
+void fault_arch_status(fault_record_t *rec);
+
+/**
+ * \brief Clear the sticky fault status bits before resuming
+ *
+ * \param cfsr CFSR bits to clear
+ * \param hfsr HFSR bits to clear
+ */
+void fault_arch_clear(uint32_t cfsr, uint32_t hfsr);
+
+/**
+ * \brief Basic frame the core stacked
+ *
+ * On ARMv8-M the caller-saved frame follows the additional state context
+ * when EXC_RETURN.DCRS is clear, and a frame stacked by the other security
+ * state cannot be read from this one.
+ *
+ * \param stack stack pointer selected by the trampoline
+ * \param excReturn lr on exception entry
+ * \return the frame, 0 if it is not readable
+ */
+uint32_t *fault_arch_frame(uint32_t stack[], uint32_t excReturn);
+
+/**
+ * \brief Write back the D-cache lines holding [addr, addr + len)
+ *
+ * Needed before a reset on cores with a write-back D-cache, a no-op when
+ * there is none or it is off.
+ */
+void fault_arch_clean(const volatile void *addr, uint32_t len);
+
+#endif
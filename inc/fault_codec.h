@@ -0,0 +1,56 @@
+#ifndef __FAULT_CODEC_H_
+#define __FAULT_CODEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fault_handler.h"
+
+/**
+ * \brief Compact crash record encoding
+ *
+ * Layout, little endian:
+ *
+ *     0xFA 0xC1 version length(2) payload(length) crc(4)
+ *
+ * crc is fault_crc32_bytes() of everything before it, so a record cut or
+ * corrupted on the way is dropped rather than decoded into garbage.
+ * The payload is a sequence of LEB128 varints: status and stacked registers
+ * as plain varints, lr and return addresses as zigzag deltas against pc,
+ * EXC_RETURN inverted, HFSR as a 3-bit cause mask. MMFAR and BFAR are only
+ * present when CFSR flags them valid, the ARMv8-M SFSR, SFAR and stack
+ * limits, the hook overrun mask, r4-r11, FP state, backtrace and stack
+ * snapshot only when recorded; each array carries its own count, so the
+ * decoder does not need the FAULT_HANDLER_* sizes of the target. Builds with
+ * FAULT_HANDLER_RTOS append the faulting task and the task table.
+ */
+
+#define FAULT_CODEC_SYNC0       0xFA  /**< First sync byte              */
+#define FAULT_CODEC_SYNC1       0xC1  /**< Second sync byte             */
+/**
+ * \brief Payload layout version, bumped on every layout change
+ *
+ * 1 first layout, 2 task section, 3 ARMv8-M SFSR, SFAR and stack limits,
+ * 4 trailing CRC.
+ * Only the current version is decoded, older payloads are rejected.
+ */
+#define FAULT_CODEC_VERSION     4
+#define FAULT_CODEC_HEADER      5     /**< Sync, version and length     */
+#define FAULT_CODEC_TRAILER     4     /**< CRC after the payload        */
+
+/** Worst case encoded size of one task entry */
+#define FAULT_CODEC_TASK_SIZE   (5 * 4 + 1 + FAULT_TASK_NAME_SIZE)
+
+/** Worst case encoded size of a record of this build */
+#if FAULT_HANDLER_RTOS
+#define FAULT_CODEC_TASKS_SIZE  (FAULT_CODEC_TASK_SIZE * (FAULT_HANDLER_RTOS_TASKS + 1) + 5)
+#else
+#define FAULT_CODEC_TASKS_SIZE  0
+#endif
+#define FAULT_CODEC_MAX_SIZE    (FAULT_CODEC_HEADER + FAULT_CODEC_TRAILER + 5 * 48 + 4 * 16 + \
+                                 5 * FAULT_HANDLER_BACKTRACE_DEPTH + 5 * FAULT_HANDLER_STACK_SNAPSHOT + \
+                                 FAULT_CODEC_TASKS_SIZE)
+
+uint32_t fault_record_encode(const fault_record_t *rec, uint8_t *buf, uint32_t size);
+bool fault_record_decode(const uint8_t *buf, uint32_t len, fault_record_t *out, uint32_t *used);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef __FAULT_CORE_H_
+#define __FAULT_CORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fault_handler.h"
+
+/**
+ * \brief ELF core file of a fault, streamed through a sink
+ *
+ * Layout, ELF32 little endian, ET_CORE for EM_ARM:
+ *
+ *     ELF header, PT_NOTE, one PT_LOAD per region, NT_PRSTATUS note, region contents
+ *
+ * The note holds r0-r15 and xPSR of the record in the ARM GNU/Linux
+ * elf_prstatus layout, which is what GDB's core file support reads; the
+ * regions are read in place while they are sent. No part of the file is
+ * ever held in RAM but one 168-byte header, rebuilt from the cursor offset,
+ * so a transfer that stalls resumes where the sink stopped taking bytes, or
+ * at any offset the host asks again from.
+ */
+
+#define FAULT_CORE_EHDR_SIZE    52   /**< ELF header                   */
+#define FAULT_CORE_PHDR_SIZE    32   /**< One program header           */
+#define FAULT_CORE_NOTE_SIZE    168  /**< NT_PRSTATUS note with its header */
+
+/**
+ * \brief Memory dumped into the core
+ *
+ * Must be readable from the fault handler: a region that faults inside
+ * HardFault locks the core up.
+ */
+typedef struct {
+	uint32_t start;  /**< First address     */
+	uint32_t size;   /**< Bytes from start  */
+} fault_core_region_t;
+
+/**
+ * \brief Position in the core file being sent
+ *
+ * offset may be set by the application to send again from a byte the host
+ * did not receive.
+ */
+typedef struct {
+	const fault_record_t *rec;  /**< Record the registers come from */
+	uint32_t offset;            /**< Bytes of the file already sent */
+} fault_core_cursor_t;
+
+void fault_core_set_regions(const fault_core_region_t *regions, uint32_t count);
+uint32_t fault_core_size(void);
+void fault_core_begin(fault_core_cursor_t *cur, const fault_record_t *rec);
+bool fault_core_write(fault_core_cursor_t *cur, const fault_sink_t *sink);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __FAULT_CRC_H_
+#define __FAULT_CRC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fault_handler.h"
+
+/**
+ * \brief Record integrity check
+ *
+ * CRC-32/MPEG-2 (polynomial 0x04C11DB7, init 0xFFFFFFFF, no reflection, no
+ * final xor) fed one 32-bit word at a time, which is what the STM32 CRC unit
+ * computes out of reset. The software path gives the same value, so records
+ * sealed by the unit are checked on the host.
+ */
+
+uint32_t fault_crc32(const uint32_t *words, uint32_t count);
+uint32_t fault_crc32_bytes(const uint8_t *buf, uint32_t len);
+#if FAULT_HANDLER_CRC
+uint32_t fault_record_crc(const fault_record_t *rec);
+bool fault_record_crc_ok(const fault_record_t *rec);
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef __FAULT_DECODE_H_
+#define __FAULT_DECODE_H_
+
+#include <stdint.h>
+#include "fault_handler_cfg.h"
+
+/**
+ * \brief Fault classes of the CFSR sub-registers, in print order
+ */
+typedef enum {
+	FAULT_CLASS_USAGE,       /**< UFSR, CFSR[31:16] */
+	FAULT_CLASS_BUS,         /**< BFSR, CFSR[15:8]  */
+	FAULT_CLASS_MEMMANAGE,   /**< MMFSR, CFSR[7:0]  */
+	FAULT_CLASS_COUNT
+} fault_class_t;
+
+/**
+ * \brief Message identifiers, index of fault_strings[]
+ */
+typedef enum {
+	FAULT_STR_NONE,
+	FAULT_STR_USAGE_TITLE,
+	FAULT_STR_BUS_TITLE,
+	FAULT_STR_MEMMANAGE_TITLE,
+	FAULT_STR_IACCVIOL,
+	FAULT_STR_DACCVIOL,
+	FAULT_STR_UNSTKERR,
+	FAULT_STR_STKERR,
+	FAULT_STR_LSPERR,
+	FAULT_STR_MMARVALID,
+	FAULT_STR_IBUSERR,
+	FAULT_STR_PRECISERR,
+	FAULT_STR_IMPRECISERR,
+	FAULT_STR_BFARVALID,
+	FAULT_STR_UNDEFINSTR,
+	FAULT_STR_INVSTATE,
+	FAULT_STR_INVPC,
+	FAULT_STR_NOCP,
+	FAULT_STR_UNALIGNED,
+	FAULT_STR_DIVBYZERO,
+	FAULT_STR_STKOF,
+	FAULT_STR_VECTTBL,
+	FAULT_STR_FORCED,
+	FAULT_STR_DEBUGEVT,
+#if FAULT_ARCH_V8M
+	FAULT_STR_SECURE_TITLE,
+	FAULT_STR_INVEP,
+	FAULT_STR_INVIS,
+	FAULT_STR_INVER,
+	FAULT_STR_AUVIOL,
+	FAULT_STR_INVTRAN,
+	FAULT_STR_SFARVALID,
+	FAULT_STR_LSERR,
+#endif
+	FAULT_STR_COUNT
+} fault_str_t;
+
+#define FAULT_BIT_ADDRESS   0x01  /**< Bit flags the class address register as valid */
+
+/**
+ * \brief Decoding of one status register bit, indexed by bit number
+ */
+typedef struct {
+	uint8_t cls;    /**< fault_class_t           */
+	uint8_t str;    /**< fault_str_t, 0 if none  */
+	uint8_t flags;  /**< FAULT_BIT_* flags       */
+} fault_bit_t;
+
+/**
+ * \brief Decoding of one CFSR sub-register
+ */
+typedef struct {
+	uint32_t mask;      /**< Bits of the class in CFSR                     */
+	uint8_t title;      /**< fault_str_t printed before the bits           */
+	uint8_t show_value; /**< Print the masked CFSR value after the title   */
+	const uint8_t *order; /**< Every bit of mask in print order, 0 for ascending */
+} fault_class_desc_t;
+
+/* Decode tables, only built with FAULT_HANDLER_DECODE */
+extern const fault_bit_t fault_cfsr_bits[32];
+extern const uint8_t fault_hfsr_bits[32];
+#if FAULT_ARCH_V8M
+extern const uint8_t fault_sfsr_bits[8];
+#endif
+extern const fault_class_desc_t fault_classes[FAULT_CLASS_COUNT];
+extern const char * const fault_strings[FAULT_STR_COUNT];
+
+uint32_t fault_ctz(uint32_t value);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __FAULT_FLASH_H_
+#define __FAULT_FLASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fault_handler.h"
+
+/**
+ * \brief Program granularity of the flash in bytes, 4 or 8
+ */
+#ifndef FAULT_FLASH_UNIT
+#define FAULT_FLASH_UNIT     8
+#endif
+
+/**
+ * \brief Value of an erased flash word
+ */
+#ifndef FAULT_FLASH_ERASED
+#define FAULT_FLASH_ERASED   0xFFFFFFFFUL
+#endif
+
+/**
+ * \brief Flash driver provided by the application
+ *
+ * The pages are only used for crash records. program() runs inside the
+ * fault handler: polled, no interrupts, no erase, bounded wait. The erase
+ * is only started on the boot path and completes in the background.
+ */
+typedef struct {
+	uintptr_t base;        /**< Address of the first page                        */
+	uint32_t page_size;    /**< Bytes per page                                   */
+	uint32_t page_count;   /**< Pages used in rotation, at least 2              */
+	bool (*program)(uintptr_t addr, const void *data, uint32_t len); /**< len is a multiple of #FAULT_FLASH_UNIT */
+	void (*erase_start)(uintptr_t addr);  /**< Start erasing the page at addr, do not wait */
+	bool (*busy)(void);                   /**< An erase or program is in progress */
+} fault_flash_t;
+
+void fault_flash_init(const fault_flash_t *flash);
+bool fault_flash_poll(void);
+bool fault_flash_store(const fault_record_t *rec);
+bool fault_flash_next(uint32_t *cursor, fault_record_t *out);
+
+#endif
@@ -2,6 +2,268 @@
 #define __FAULT_HANDLER_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "fault_sink.h"
+#include "fault_rtos.h"
+#include "fault_handler_cfg.h"
+
+/**
+ * \brief Place a variable in a section not cleared by the startup code
+ *
+ * GCC/Clang need a NOLOAD ".noinit" output section in the linker script,
+ * Keil needs the ".bss.noinit" section in an UNINIT execution region.
+ */
+#if defined(__ICCARM__)
+#define FAULT_NOINIT        __no_init
+#elif defined(__CC_ARM)
+#define FAULT_NOINIT        __attribute__((section(".bss.noinit"), zero_init))
+#else
+#define FAULT_NOINIT        __attribute__((section(".noinit")))
+#endif
+
+#if defined(__CC_ARM) || defined(__ICCARM__)
+#define FAULT_PACKED_BEGIN  __packed
+#define FAULT_PACKED_END
+#else
+#define FAULT_PACKED_BEGIN
+#define FAULT_PACKED_END    __attribute__((packed, aligned(4)))
+#endif
+
+#define FAULT_RECORD_MAGIC  0xFA017EC0UL  /**< Record slot holds an undrained record */
+#define FAULT_RING_MAGIC    0xFA0121A6UL  /**< Ring header is valid                  */
+#define FAULT_STATS_MAGIC   0xFA0157A7UL  /**< Statistics are valid                  */
+#define FAULT_BOOT_MAGIC    0xFA01B007UL  /**< Boot history is valid                 */
+
+#define FAULT_FLAG_CONTEXT  0x00000001UL  /**< r4-r11, msp and psp are valid             */
+#define FAULT_FLAG_NO_FRAME 0x00000002UL  /**< Stacking failed or frame not readable, r0-psr were not read */
+#define FAULT_FLAG_FP_FRAME 0x00000004UL  /**< Extended frame, EXC_RETURN bit 4 clear     */
+#define FAULT_FLAG_FP_REGS  0x00000008UL  /**< fpscr and s[] hold the stacked FP state    */
+#define FAULT_FLAG_TASK     0x00000010UL  /**< Taken from a task, task holds it           */
+#define FAULT_FLAG_HOOK_OVERRUN 0x00000020UL  /**< A hook overran, see hook_overrun        */
+#define FAULT_FLAG_V8M      0x00000040UL  /**< sfsr, sfar, msplim and psplim are valid    */
+
+/**
+ * \brief Stack of one task in a crash record
+ *
+ * The stack overflowed when sp is below base or nothing is left unused.
+ */
+typedef FAULT_PACKED_BEGIN struct {
+	uint32_t id;                        /**< Adapter task number                        */
+	uint32_t sp;                        /**< Saved sp, frame address for the faulting task */
+	uint32_t base;                      /**< Lowest address of the stack                */
+	uint32_t unused;                    /**< Bytes never written, or #FAULT_TASK_UNKNOWN */
+	char name[FAULT_TASK_NAME_SIZE];    /**< Truncated, not terminated when full        */
+} FAULT_PACKED_END fault_task_record_t;
+
+/**
+ * \brief What the handler does after a fault is recorded
+ *
+ * Ordered from the most to the least conservative: when several causes are
+ * set the lowest action wins.
+ */
+typedef enum {
+	FAULT_ACTION_HALT = 0,  /**< Stop in the handler, the default            */
+	FAULT_ACTION_RESET,     /**< System reset through AIRCR.SYSRESETREQ      */
+	FAULT_ACTION_REDIRECT,  /**< Resume at the landing function              */
+	FAULT_ACTION_SKIP,      /**< Resume after the faulting instruction       */
+} fault_action_t;
+
+/** Landing function of #FAULT_ACTION_REDIRECT, it must not return */
+typedef void (*fault_landing_t)(void);
+
+/**
+ * \brief Registers pushed by the trampoline, lowest address first
+ *
+ * Matches "STMDB sp!, {r0-r2, r4-r11, lr}" with r0 holding the stacked frame
+ * address, r1 MSP and r2 PSP as they were on exception entry.
+ */
+typedef struct {
+	uint32_t *frame;      /**< Hardware-stacked frame (MSP or PSP) */
+	uint32_t msp;         /**< MSP on exception entry              */
+	uint32_t psp;         /**< PSP on exception entry              */
+	uint32_t r4;
+	uint32_t r5;
+	uint32_t r6;
+	uint32_t r7;
+	uint32_t r8;
+	uint32_t r9;
+	uint32_t r10;
+	uint32_t r11;
+	uint32_t exc_return;  /**< lr on exception entry               */
+} fault_context_t;
+
+/**
+ * \brief Binary crash record
+ *
+ * Fault status registers and the eight registers the core stacks on
+ * exception entry. Only 32-bit words, so the layout is the same for target
+ * and host tools; build the host tools with the same FAULT_HANDLER_* sizes.
+ * On ARMv6-M and ARMv8-M Baseline the fault status registers do not exist,
+ * they are recorded as 0.
+ */
+typedef FAULT_PACKED_BEGIN struct {
+	uint32_t magic;  /**< #FAULT_RECORD_MAGIC, written last */
+	uint32_t seq;    /**< Sequence number, never reused     */
+	uint32_t flags;  /**< FAULT_FLAG_* bits                  */
+	uint32_t exception; /**< Active exception: 3 HardFault, 4 MemManage, 5 BusFault, 6 UsageFault, 7 SecureFault */
+	uint32_t action; /**< #fault_action_t taken after the record was stored */
+	uint32_t signature; /**< Hash of pc, lr, cfsr and hfsr */
+	uint32_t count;  /**< Occurrences of this signature, 1 without deduplication */
+	uint32_t last_seq; /**< Sequence number of the last occurrence */
+	uint32_t boot;   /**< Boot number, counted by fault_handler_boot_check() */
+	uint32_t uptime; /**< ms since boot, 0 without fault_handler_set_uptime() */
+#if FAULT_HANDLER_HOOKS > 0
+	uint32_t hook_overrun; /**< Hooks over budget, bit n for the n-th run */
+#endif
+	uint32_t hfsr;   /**< SCB->HFSR  */
+	uint32_t cfsr;   /**< SCB->CFSR  */
+	uint32_t mmfar;  /**< SCB->MMFAR */
+	uint32_t bfar;   /**< SCB->BFAR  */
+	uint32_t afsr;   /**< SCB->AFSR  */
+	uint32_t shcsr;  /**< SCB->SHCSR */
+#if FAULT_ARCH_V8M
+	uint32_t sfsr;   /**< SAU->SFSR, reads 0 from Non-secure state */
+	uint32_t sfar;   /**< SAU->SFAR, valid with SFSR.SFARVALID     */
+	uint32_t msplim; /**< MSPLIM of the handler security state     */
+	uint32_t psplim; /**< PSPLIM of the handler security state     */
+#endif
+	uint32_t r0;     /**< Stacked r0  */
+	uint32_t r1;     /**< Stacked r1  */
+	uint32_t r2;     /**< Stacked r2  */
+	uint32_t r3;     /**< Stacked r3  */
+	uint32_t r12;    /**< Stacked r12 */
+	uint32_t lr;     /**< Stacked lr  */
+	uint32_t pc;     /**< Stacked pc  */
+	uint32_t psr;    /**< Stacked psr */
+	uint32_t r4;     /**< r4, valid with #FAULT_FLAG_CONTEXT  */
+	uint32_t r5;
+	uint32_t r6;
+	uint32_t r7;
+	uint32_t r8;
+	uint32_t r9;
+	uint32_t r10;
+	uint32_t r11;
+	uint32_t exc_return; /**< EXC_RETURN */
+	uint32_t msp;    /**< MSP on exception entry, valid with #FAULT_FLAG_CONTEXT */
+	uint32_t psp;    /**< PSP on exception entry, valid with #FAULT_FLAG_CONTEXT */
+#if FAULT_HANDLER_FPU
+	uint32_t fpscr;  /**< Stacked FPSCR, valid with #FAULT_FLAG_FP_REGS  */
+	uint32_t s[16];  /**< Stacked s0-s15, valid with #FAULT_FLAG_FP_REGS */
+#endif
+#if FAULT_HANDLER_BACKTRACE_DEPTH > 0
+	uint32_t backtrace_count;                          /**< Valid entries of backtrace[] */
+	uint32_t backtrace[FAULT_HANDLER_BACKTRACE_DEPTH]; /**< Return addresses, innermost first */
+#endif
+#if FAULT_HANDLER_STACK_SNAPSHOT > 0
+	uint32_t snapshot_addr;                            /**< Address of snapshot[0]       */
+	uint32_t snapshot_count;                           /**< Valid words of snapshot[]    */
+	uint32_t snapshot[FAULT_HANDLER_STACK_SNAPSHOT];   /**< Raw stack from the frame up  */
+#endif
+#if FAULT_HANDLER_RTOS
+	fault_task_record_t task;                          /**< Valid with #FAULT_FLAG_TASK  */
+	uint32_t task_count;                               /**< Valid entries of tasks[]     */
+	fault_task_record_t tasks[FAULT_HANDLER_RTOS_TASKS]; /**< Every task, adapter order  */
+#endif
+#if FAULT_HANDLER_CRC
+	uint32_t crc;                                      /**< fault_record_crc(), last     */
+#endif
+} FAULT_PACKED_END fault_record_t;
+
+/**
+ * \brief Ring of crash records in retained RAM
+ */
+typedef struct {
+	uint32_t magic;                                 /**< #FAULT_RING_MAGIC        */
+	uint32_t seq;                                   /**< Next sequence number     */
+	uint32_t head;                                  /**< Next slot to be written  */
+	fault_record_t slot[FAULT_HANDLER_RING_SIZE];   /**< Records                  */
+} fault_ring_t;
+
+/** Retained crash records, filled before any output is produced */
+extern fault_ring_t fault_ring;
+
+#if FAULT_HANDLER_STATS
+/**
+ * \brief HFSR causes counted by the statistics
+ */
+enum {
+	FAULT_STATS_VECTTBL = 0,  /**< HFSR.VECTTBL  */
+	FAULT_STATS_FORCED,       /**< HFSR.FORCED   */
+	FAULT_STATS_DEBUGEVT,     /**< HFSR.DEBUGEVT */
+	FAULT_STATS_HFSR_COUNT
+};
+
+/**
+ * \brief Aggregate fault counters, kept in retained RAM across resets
+ *
+ * top[] holds the most frequent faulting pc values as counted by the
+ * space-saving algorithm: a count can overestimate by at most the count of
+ * the entry it replaced, it never underestimates.
+ */
+typedef struct {
+	uint32_t magic;                          /**< #FAULT_STATS_MAGIC              */
+	uint32_t total;                          /**< Faults recorded                 */
+	uint32_t cfsr[32];                       /**< Faults with each CFSR bit set   */
+	uint32_t hfsr[FAULT_STATS_HFSR_COUNT];   /**< Faults with each HFSR cause set */
+	struct {
+		uint32_t pc;                         /**< Stacked pc                      */
+		uint32_t count;                      /**< Faults at pc, 0 if unused       */
+	} top[FAULT_HANDLER_STATS_TOP];
+} fault_stats_t;
+#endif
+
+/**
+ * \brief Callback run by the handler once the record is stored
+ *
+ * It runs in HardFault context, before any output; the record is not final
+ * yet (action, task table). See fault_handler_add_hook().
+ */
+typedef void (*fault_hook_t)(const fault_record_t *rec);
+
+#if FAULT_HANDLER_BENCH
+/**
+ * \brief CYCCNT at the three points of the last fault
+ */
+typedef struct {
+	uint32_t entry;   /**< First instruction of the trampoline          */
+	uint32_t record;  /**< Crash record committed to the ring           */
+	uint32_t output;  /**< Output flushed, before the action is applied */
+} fault_bench_t;
+
+extern volatile fault_bench_t fault_bench;
+#endif
+
+#if FAULT_HANDLER_SEPARATE_HANDLERS
+void fault_handler_init(uint32_t priority);
+#endif
+void fault_handler_set_sink(const fault_sink_t *sink);
+#if FAULT_HANDLER_RECOVERY
+void fault_handler_set_policy(uint32_t cfsr_bits, fault_action_t action, fault_landing_t landing);
+#endif
+uint32_t fault_handler_fault_stack_used(void);
+#if FAULT_HANDLER_HOOKS > 0
+bool fault_handler_add_hook(fault_hook_t hook, uint32_t priority, uint32_t budget);
+void fault_handler_remove_hook(fault_hook_t hook);
+bool fault_hook_expired(void);
+#endif
+#if FAULT_HANDLER_PROBE
+bool fault_probe_read32(uintptr_t addr, uint32_t *out);
+bool fault_probe_write32(uintptr_t addr, uint32_t value);
+#endif
+#if FAULT_HANDLER_STATS
+void fault_stats_get(fault_stats_t *out);
+void fault_stats_clear(void);
+#endif
+void fault_write(const fault_sink_t *sink, const void *buf, uint32_t len);
+void fault_print_record(const fault_record_t *rec, const fault_sink_t *sink);
+void fault_handler_set_uptime(uint32_t (*uptime_ms)(void));
+#if FAULT_HANDLER_RTOS
+void fault_handler_set_rtos(const fault_rtos_t *rtos);
+#endif
+uint32_t fault_handler_boot_check(void);
+bool fault_handler_safe_mode(void);
+void fault_handler_loop_clear(void);
+bool fault_handler_read_record(fault_record_t *out);
 
 uint8_t bus_fault_code(void);
 uint8_t divide_by_zero(void);
@@ -9,4 +271,4 @@ uint8_t call_to_null_function(void);
 uint8_t dangling_pointer(void);
 uint32_t dangling_pointer2(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,457 @@
+#ifndef __FAULT_HANDLER_CFG_H_
+#define __FAULT_HANDLER_CFG_H_
+
+/**
+ * \file
+ * \brief Compile-time configuration of the fault handler
+ *
+ * Every FAULT_HANDLER_* switch has a default here and can be overridden on
+ * the command line or in a product header named by
+ * FAULT_HANDLER_CONFIG_FILE, e.g. -DFAULT_HANDLER_CONFIG_FILE='"board_fault_cfg.h"'.
+ * Disabled features are removed by the preprocessor, not left to the
+ * linker: no code, no tables, no record fields. tools/size_report.sh
+ * measures the cost of each combination.
+ *
+ * Feature switches, each removes its code and record fields when off:
+ *
+ *     FAULT_HANDLER_BACKTRACE_DEPTH   0 no stack scan for callers
+ *     FAULT_HANDLER_STACK_SNAPSHOT    0 no raw stack copy
+ *     FAULT_HANDLER_FPU               0 no FP state
+ *     FAULT_HANDLER_RTOS              FAULT_RTOS_NONE no task table
+ *     FAULT_HANDLER_STATS             0 no retained counters
+ *     FAULT_HANDLER_DEDUP, _RECOVERY, _PROBE, _CRC, _HOOKS, _LOOP_FAULTS, _FLASH
+ */
+
+#ifdef FAULT_HANDLER_CONFIG_FILE
+#include FAULT_HANDLER_CONFIG_FILE
+#endif
+
+#define FAULT_LEVEL_NONE    0  /**< Record in the retained ring only, no output           */
+#define FAULT_LEVEL_RAW     1  /**< Binary record through the sink, text on the host       */
+#define FAULT_LEVEL_CODES   2  /**< Text with register and status values, bits unexplained */
+#define FAULT_LEVEL_TEXT    3  /**< Full text, every set status bit explained              */
+
+/**
+ * \brief Output verbosity, one of FAULT_LEVEL_*
+ *
+ * Derived from FAULT_HANDLER_CAPTURE_ONLY and FAULT_HANDLER_NO_STRINGS when
+ * only those are set, so older configurations build unchanged.
+ */
+#ifndef FAULT_HANDLER_LEVEL
+#if defined(FAULT_HANDLER_CAPTURE_ONLY) && FAULT_HANDLER_CAPTURE_ONLY
+#define FAULT_HANDLER_LEVEL  FAULT_LEVEL_NONE
+#elif defined(FAULT_HANDLER_NO_STRINGS) && FAULT_HANDLER_NO_STRINGS
+#define FAULT_HANDLER_LEVEL  FAULT_LEVEL_RAW
+#else
+#define FAULT_HANDLER_LEVEL  FAULT_LEVEL_TEXT
+#endif
+#endif
+
+#if FAULT_HANDLER_LEVEL < FAULT_LEVEL_NONE || FAULT_HANDLER_LEVEL > FAULT_LEVEL_TEXT
+#error FAULT_HANDLER_LEVEL must be one of FAULT_LEVEL_*
+#endif
+
+#define FAULT_ARCH_V6M        0  /**< Cortex-M0/M0+/M1: HardFault only, no CFSR, Thumb-1  */
+#define FAULT_ARCH_V7M        1  /**< Cortex-M3/M4/M7: CFSR, D-cache on M7                */
+#define FAULT_ARCH_V8M_BASE   2  /**< Cortex-M23: as ARMv6-M for the handler              */
+#define FAULT_ARCH_V8M_MAIN   3  /**< Cortex-M33/M55: ARMv7-M plus SecureFault, stack limits */
+
+/**
+ * \brief Core architecture, one of FAULT_ARCH_*
+ *
+ * Selects the backend (src/fault_arch_v6m.c or src/fault_arch_v7m.c), the
+ * trampoline instruction set and the architecture fields of the record.
+ * Detected from the compiler target; build the host tools with the value
+ * of the target, ARMv8-M Mainline records are longer.
+ */
+#ifndef FAULT_HANDLER_ARCH
+#if defined(__ARM_ARCH_6M__) || defined(__TARGET_ARCH_6S_M)
+#define FAULT_HANDLER_ARCH   FAULT_ARCH_V6M
+#elif defined(__ARM_ARCH_8M_BASE__)
+#define FAULT_HANDLER_ARCH   FAULT_ARCH_V8M_BASE
+#elif defined(__ARM_ARCH_8M_MAIN__) || defined(__ARM_ARCH_8_1M_MAIN__)
+#define FAULT_HANDLER_ARCH   FAULT_ARCH_V8M_MAIN
+#elif defined(__ICCARM__) && defined(__ARM_ARCH) && __ARM_ARCH == 6
+#define FAULT_HANDLER_ARCH   FAULT_ARCH_V6M
+#elif defined(__ICCARM__) && defined(__ARM_ARCH) && __ARM_ARCH == 8
+#if defined(__ARM_ARCH_ISA_THUMB) && __ARM_ARCH_ISA_THUMB == 1
+#define FAULT_HANDLER_ARCH   FAULT_ARCH_V8M_BASE
+#else
+#define FAULT_HANDLER_ARCH   FAULT_ARCH_V8M_MAIN
+#endif
+#else
+#define FAULT_HANDLER_ARCH   FAULT_ARCH_V7M
+#endif
+#endif
+
+#if FAULT_HANDLER_ARCH < FAULT_ARCH_V6M || FAULT_HANDLER_ARCH > FAULT_ARCH_V8M_MAIN
+#error FAULT_HANDLER_ARCH must be one of FAULT_ARCH_*
+#endif
+
+/** CFSR, MMFAR, BFAR and the configurable fault exceptions exist */
+#define FAULT_ARCH_CFSR     (FAULT_HANDLER_ARCH == FAULT_ARCH_V7M || FAULT_HANDLER_ARCH == FAULT_ARCH_V8M_MAIN)
+
+/** SFSR, SFAR, MSPLIM and PSPLIM exist and are recorded */
+#define FAULT_ARCH_V8M      (FAULT_HANDLER_ARCH == FAULT_ARCH_V8M_MAIN)
+
+/**
+ * \brief Clean the retained state from the D-cache before a reset
+ *
+ * A write-back cache keeps the record in lines the reset discards. When set
+ * to 1 the ring, statistics and boot history are cleaned by address once
+ * final; a no-op at run time while CCR.DC is clear, so it is safe on cores
+ * without a cache (M3/M4).
+ */
+#ifndef FAULT_HANDLER_DCACHE
+#define FAULT_HANDLER_DCACHE   FAULT_ARCH_CFSR
+#endif
+
+/** D-cache line size in bytes, 32 on Cortex-M7 and M55 */
+#ifndef FAULT_HANDLER_DCACHE_LINE
+#define FAULT_HANDLER_DCACHE_LINE   32
+#endif
+
+/**
+ * \brief Capture-only mode, the same as #FAULT_LEVEL_NONE
+ *
+ * When set to 1 the handler only fills the crash record and stops: no
+ * sprintf, no printf, and no formatting code is linked in.
+ */
+#ifndef FAULT_HANDLER_CAPTURE_ONLY
+#define FAULT_HANDLER_CAPTURE_ONLY   (FAULT_HANDLER_LEVEL == FAULT_LEVEL_NONE)
+#endif
+
+/**
+ * \brief Full register capture
+ *
+ * When set to 1 the HardFault_Handler trampoline pushes r4-r11 and EXC_RETURN
+ * with a single STMDB (four PUSH on ARMv6-M) and passes a #fault_context_t
+ * to the C handler. When 0 only the hardware-stacked frame is recorded.
+ */
+#ifndef FAULT_HANDLER_FULL_CONTEXT
+#define FAULT_HANDLER_FULL_CONTEXT   1
+#endif
+
+/**
+ * \brief Size in bytes of the dedicated fault stack, 0 to run on the faulting MSP
+ *
+ * When not 0 the trampoline moves MSP to a reserved stack before pushing
+ * anything, so a MSTKERR/STKERR fault does not double-fault into lockup.
+ * Needs FAULT_HANDLER_FULL_CONTEXT, the original MSP is kept in the context.
+ * A fault taken while MSP is already inside the fault stack, by a handler
+ * running there, stays on it below the outer handler. At most 65535 bytes.
+ * On ARMv8-M Mainline MemManage, BusFault, UsageFault and SecureFault stay
+ * on MSP, MSPLIM being enforced at their priority; HardFault switches.
+ *
+ * Worst case usage is the 48-byte trampoline context plus the deepest C call
+ * chain of the handler and the selected sink: check it with GCC
+ * -fstack-usage, the IAR linker stack usage analysis or the Keil static call
+ * graph, and with fault_handler_fault_stack_used() on target.
+ */
+#ifndef FAULT_HANDLER_FAULT_STACK_SIZE
+#define FAULT_HANDLER_FAULT_STACK_SIZE   0
+#endif
+
+/**
+ * \brief Sink used for the text dump until fault_handler_set_sink() is called
+ */
+#ifndef FAULT_HANDLER_DEFAULT_SINK
+#define FAULT_HANDLER_DEFAULT_SINK   fault_sink_semihost
+#endif
+
+/**
+ * \brief String-free build, the same as #FAULT_LEVEL_RAW
+ *
+ * When set to 1 no message string is linked in: the handler sends the raw
+ * crash record through the sink instead of text, and tools/fault_decoder
+ * prints the text on the host.
+ */
+#ifndef FAULT_HANDLER_NO_STRINGS
+#define FAULT_HANDLER_NO_STRINGS     (FAULT_HANDLER_LEVEL == FAULT_LEVEL_RAW)
+#endif
+
+/**
+ * \brief Send the compact encoding of fault_codec.h instead of the raw record
+ *
+ * Only used with FAULT_HANDLER_NO_STRINGS. Costs a static buffer of
+ * FAULT_CODEC_MAX_SIZE bytes.
+ */
+#ifndef FAULT_HANDLER_COMPACT
+#define FAULT_HANDLER_COMPACT        0
+#endif
+
+/** Text dump is built in */
+#define FAULT_HANDLER_TEXT  (!FAULT_HANDLER_CAPTURE_ONLY && !FAULT_HANDLER_NO_STRINGS)
+
+/** The text dump explains each status bit, fault_decode.c tables are built in */
+#define FAULT_HANDLER_DECODE  (FAULT_HANDLER_TEXT && FAULT_HANDLER_LEVEL >= FAULT_LEVEL_TEXT)
+
+#if FAULT_HANDLER_CAPTURE_ONLY != (FAULT_HANDLER_LEVEL == FAULT_LEVEL_NONE) || \
+    (!FAULT_HANDLER_CAPTURE_ONLY && FAULT_HANDLER_NO_STRINGS != (FAULT_HANDLER_LEVEL == FAULT_LEVEL_RAW))
+#error FAULT_HANDLER_LEVEL contradicts FAULT_HANDLER_CAPTURE_ONLY or FAULT_HANDLER_NO_STRINGS
+#endif
+
+/**
+ * \brief Number of crash records kept in retained RAM
+ */
+#ifndef FAULT_HANDLER_RING_SIZE
+#define FAULT_HANDLER_RING_SIZE      4
+#endif
+
+/**
+ * \brief Code region: backtrace candidates must fall in [START, END)
+ */
+#ifndef FAULT_HANDLER_CODE_START
+#define FAULT_HANDLER_CODE_START     0x08000000UL
+#endif
+#ifndef FAULT_HANDLER_CODE_END
+#define FAULT_HANDLER_CODE_END       0x08100000UL
+#endif
+
+/**
+ * \brief RAM region: the handler never reads stack memory outside [START, END)
+ */
+#ifndef FAULT_HANDLER_RAM_START
+#define FAULT_HANDLER_RAM_START      0x20000000UL
+#endif
+#ifndef FAULT_HANDLER_RAM_END
+#define FAULT_HANDLER_RAM_END        0x20020000UL
+#endif
+
+/**
+ * \brief Return addresses kept by the heuristic backtrace, 0 to disable it
+ */
+#ifndef FAULT_HANDLER_BACKTRACE_DEPTH
+#define FAULT_HANDLER_BACKTRACE_DEPTH  8
+#endif
+
+/**
+ * \brief Stack words scanned by the heuristic backtrace
+ *
+ * Hard cap, together with #FAULT_HANDLER_BACKTRACE_DEPTH it bounds the cost.
+ */
+#ifndef FAULT_HANDLER_BACKTRACE_SCAN
+#define FAULT_HANDLER_BACKTRACE_SCAN   128
+#endif
+
+/**
+ * \brief Stack words copied into the crash record, 0 to disable the snapshot
+ *
+ * Copied from the exception frame upwards and clamped to the RAM region.
+ * Must be a multiple of 4.
+ */
+#ifndef FAULT_HANDLER_STACK_SNAPSHOT
+#define FAULT_HANDLER_STACK_SNAPSHOT   32
+#endif
+
+/**
+ * \brief FPU support: record FPSCR and s0-s15 from extended exception frames
+ *
+ * Defaults to 1 when the compiler targets a FPU.
+ */
+#ifndef FAULT_HANDLER_FPU
+#if defined(__ARM_FP) || defined(__TARGET_FPU_VFP) || defined(__ARMVFP__)
+#define FAULT_HANDLER_FPU              1
+#else
+#define FAULT_HANDLER_FPU              0
+#endif
+#endif
+
+/**
+ * \brief Dedicated MemManage, BusFault and UsageFault entry points
+ *
+ * When set to 1 MemManage_Handler, BusFault_Handler and UsageFault_Handler
+ * are defined here (remove them from the vendor stm32xxx_it.c) and
+ * fault_handler_init() enables them. They share the HardFault capture path.
+ * SecureFault_Handler is added on ARMv8-M Mainline. Not available on
+ * ARMv6-M and ARMv8-M Baseline.
+ */
+#ifndef FAULT_HANDLER_SEPARATE_HANDLERS
+#define FAULT_HANDLER_SEPARATE_HANDLERS  0
+#endif
+
+/**
+ * \brief Implemented priority bits of the NVIC, __NVIC_PRIO_BITS in CMSIS
+ */
+#ifndef FAULT_HANDLER_NVIC_PRIO_BITS
+#define FAULT_HANDLER_NVIC_PRIO_BITS     4
+#endif
+
+/**
+ * \brief Recoverable faults
+ *
+ * When set to 1 fault_handler_set_policy() selects, per CFSR cause, whether
+ * the handler stops, resets, skips the faulting instruction or resumes at a
+ * landing function once the record is stored and printed. Defaults to halt.
+ */
+#ifndef FAULT_HANDLER_RECOVERY
+#define FAULT_HANDLER_RECOVERY           1
+#endif
+
+/**
+ * \brief Production mode: reset instead of halting
+ *
+ * When set to 1 every fault that would stop in the handler requests a
+ * system reset through AIRCR.SYSRESETREQ once the record is in retained
+ * RAM, instead of waiting for the watchdog. Resume policies still apply.
+ */
+#ifndef FAULT_HANDLER_RESET_ON_FAULT
+#define FAULT_HANDLER_RESET_ON_FAULT     0
+#endif
+
+/**
+ * \brief CPU cycles the output may take before a reset, 0 for no limit
+ *
+ * Measured with the DWT cycle counter from the start of the output when the
+ * action is a reset; what is left unsent when it runs out is dropped.
+ */
+#ifndef FAULT_HANDLER_OUTPUT_BUDGET
+#define FAULT_HANDLER_OUTPUT_BUDGET      0
+#endif
+
+/**
+ * \brief Stream an ELF core file for gdb after the record
+ *
+ * Registers of the record plus the regions of fault_core_set_regions(), by
+ * default the RAM region, see fault_core.h. A halted handler keeps feeding
+ * it to the sink while it stalls; a reset sends what fits the output budget.
+ */
+#ifndef FAULT_HANDLER_CORE
+#define FAULT_HANDLER_CORE               0
+#endif
+
+/**
+ * \brief Fault-backed memory probes
+ *
+ * When set to 1 fault_probe_read32() and fault_probe_write32() return false
+ * instead of crashing when the access faults, to map the RAM and peripheral
+ * windows of a part at bring-up.
+ */
+#ifndef FAULT_HANDLER_PROBE
+#define FAULT_HANDLER_PROBE              1
+#endif
+
+/**
+ * \brief Benchmark build: timestamp the fault path with the DWT cycle counter
+ *
+ * When set to 1 the trampoline and the C handler store CYCCNT in
+ * #fault_bench; src/bench_main.c uses it. The counter must be running.
+ */
+#ifndef FAULT_HANDLER_BENCH
+#define FAULT_HANDLER_BENCH              0
+#endif
+
+/**
+ * \brief Self-test build: src/selftest_main.c replaces main.c
+ *
+ * Runs every test routine in one boot and checks the captured records,
+ * see tools/qemu_selftest.sh.
+ */
+#ifndef FAULT_HANDLER_SELFTEST
+#define FAULT_HANDLER_SELFTEST           0
+#endif
+
+/**
+ * \brief Crash signature deduplication
+ *
+ * When set to 1 a fault with the same stacked pc, lr, CFSR and HFSR as an
+ * undrained record only bumps its count and last_seq, so a crash loop does
+ * not push older records out of the ring.
+ */
+#ifndef FAULT_HANDLER_DEDUP
+#define FAULT_HANDLER_DEDUP              1
+#endif
+
+/**
+ * \brief Crash loop detection in fault_handler_boot_check()
+ *
+ * fault_handler_safe_mode() turns true when the last
+ * #FAULT_HANDLER_LOOP_FAULTS faults all happened within the last
+ * #FAULT_HANDLER_LOOP_BOOTS boots, or in consecutive boots each within
+ * #FAULT_HANDLER_LOOP_UPTIME_MS of boot. Only faults that reset or halt
+ * count, one recovered by a skip or redirect policy does not end the boot.
+ * 0 faults disables it.
+ */
+#ifndef FAULT_HANDLER_LOOP_FAULTS
+#define FAULT_HANDLER_LOOP_FAULTS        3
+#endif
+#ifndef FAULT_HANDLER_LOOP_BOOTS
+#define FAULT_HANDLER_LOOP_BOOTS         5
+#endif
+/** 0 disables the uptime rule, it needs fault_handler_set_uptime() */
+#ifndef FAULT_HANDLER_LOOP_UPTIME_MS
+#define FAULT_HANDLER_LOOP_UPTIME_MS     0
+#endif
+
+/**
+ * \brief Persist each new record in pre-erased flash, see fault_flash.h
+ *
+ * Needs fault_flash_init() with the application flash driver at boot.
+ */
+#ifndef FAULT_HANDLER_FLASH
+#define FAULT_HANDLER_FLASH              0
+#endif
+
+/**
+ * \brief CRC32 over each record, checked by fault_handler_boot_check()
+ *
+ * A record cut by a nested fault or a brown-out is dropped instead of being
+ * reported, see fault_crc.h.
+ */
+#ifndef FAULT_HANDLER_CRC
+#define FAULT_HANDLER_CRC                1
+#endif
+
+/**
+ * \brief CRC unit of the MCU: 0 software tables, 1 STM32 fixed polynomial
+ * unit (F1/F2/F4/L1), 2 STM32 programmable unit (F0/F3/F7/G4/L4/H7)
+ *
+ * The application enables the unit clock before fault_handler_boot_check()
+ * and does not use the unit itself.
+ */
+#ifndef FAULT_HANDLER_CRC_HW
+#define FAULT_HANDLER_CRC_HW             0
+#endif
+/** Base address of the CRC unit */
+#ifndef FAULT_HANDLER_CRC_BASE
+#define FAULT_HANDLER_CRC_BASE           0x40023000UL
+#endif
+
+/**
+ * \brief Retained fault counters, read with fault_stats_get()
+ */
+#ifndef FAULT_HANDLER_STATS
+#define FAULT_HANDLER_STATS              1
+#endif
+
+/**
+ * \brief Faulting pc values tracked by the statistics, the most frequent ones
+ */
+#ifndef FAULT_HANDLER_STATS_TOP
+#define FAULT_HANDLER_STATS_TOP          4
+#endif
+
+/**
+ * \brief Post-capture callbacks that fault_handler_add_hook() can register
+ */
+#ifndef FAULT_HANDLER_HOOKS
+#define FAULT_HANDLER_HOOKS              4
+#endif
+
+/**
+ * \brief Record the faulting task and every task stack, one of FAULT_RTOS_*
+ *
+ * The adapter is installed with fault_handler_set_rtos(), see fault_rtos.h.
+ */
+#ifndef FAULT_HANDLER_RTOS
+#define FAULT_HANDLER_RTOS               FAULT_RTOS_NONE
+#endif
+
+/**
+ * \brief Tasks kept in the per-task stack table of a record
+ */
+#ifndef FAULT_HANDLER_RTOS_TASKS
+#define FAULT_HANDLER_RTOS_TASKS         8
+#endif
+
+#endif
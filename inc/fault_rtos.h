@@ -0,0 +1,57 @@
+#ifndef __FAULT_RTOS_H_
+#define __FAULT_RTOS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FAULT_RTOS_NONE        0  /**< No task capture                       */
+#define FAULT_RTOS_FREERTOS    1  /**< src/fault_rtos_freertos.c             */
+#define FAULT_RTOS_ZEPHYR      2  /**< src/fault_rtos_zephyr.c               */
+#define FAULT_RTOS_CUSTOM      3  /**< Adapter provided by the application   */
+
+/** Bytes of task name kept in a record, multiple of 4 */
+#ifndef FAULT_TASK_NAME_SIZE
+#define FAULT_TASK_NAME_SIZE   8
+#endif
+
+/** fault_task_t::unused when the RTOS does not track the high-water mark */
+#define FAULT_TASK_UNKNOWN     0xFFFFFFFFUL
+
+/**
+ * \brief One task as seen by the RTOS adapter
+ */
+typedef struct {
+	uint32_t id;           /**< Task number, for display only                  */
+	const char *name;      /**< 0 if the RTOS keeps no names                   */
+	uintptr_t sp;          /**< Saved stack pointer                             */
+	uintptr_t base;        /**< Lowest address of the stack                     */
+	uint32_t unused;       /**< Stack bytes never written, or #FAULT_TASK_UNKNOWN */
+} fault_task_t;
+
+/**
+ * \brief RTOS adapter used by the handler to name the faulting task
+ *
+ * Both functions run inside the fault handler, after the record is
+ * committed: they must only read kernel data, never lock, wait or allocate.
+ * current() is only called for faults taken from thread mode on PSP. task()
+ * fills in the \p index-th task, counting from 0, and returns false past
+ * the last one.
+ */
+typedef struct {
+	bool (*current)(fault_task_t *task);              /**< Task running when the fault hit */
+	bool (*task)(uint32_t index, fault_task_t *task); /**< Iterate over all tasks          */
+} fault_rtos_t;
+
+extern const fault_rtos_t fault_rtos_freertos;
+extern const fault_rtos_t fault_rtos_zephyr;
+
+/* FreeRTOS has no lock-free task walk: the adapter tracks the tasks from
+ * the trace macros, add to FreeRTOSConfig.h:
+ *
+ *     #define traceTASK_CREATE(xTask)  fault_freertos_task_created(xTask)
+ *     #define traceTASK_DELETE(xTask)  fault_freertos_task_deleted(xTask)
+ */
+void fault_freertos_task_created(void *task);
+void fault_freertos_task_deleted(void *task);
+
+#endif
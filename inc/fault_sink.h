@@ -0,0 +1,72 @@
+#ifndef __FAULT_SINK_H_
+#define __FAULT_SINK_H_
+
+#include <stdint.h>
+
+/**
+ * \brief Output sink used by the fault handler for its text dump
+ *
+ * write() may accept less than \p len bytes and returns how many it took;
+ * returning 0 means the sink cannot make progress and the rest is dropped.
+ * Both functions run inside the fault handler: they must not allocate, use
+ * interrupts or wait without a bound.
+ */
+typedef struct {
+	uint32_t (*write)(const void *buf, uint32_t len); /**< Send bytes               */
+	void (*flush)(void);                              /**< Wait until bytes are out */
+} fault_sink_t;
+
+/**
+ * \brief Upper bound of polling iterations a sink spends waiting for room
+ */
+#ifndef FAULT_SINK_SPIN_LIMIT
+#define FAULT_SINK_SPIN_LIMIT        100000UL
+#endif
+
+/**
+ * \brief Size of the RTT-style up-buffer
+ */
+#ifndef FAULT_SINK_RTT_BUFFER_SIZE
+#define FAULT_SINK_RTT_BUFFER_SIZE   1024
+#endif
+
+/**
+ * \brief Identifier the debugger searches RAM for to find the RTT control block
+ */
+#ifndef FAULT_SINK_RTT_ID
+#define FAULT_SINK_RTT_ID            "SEGGER RTT"
+#endif
+
+/**
+ * \brief RTT up-buffer descriptor, same layout as SEGGER RTT
+ */
+typedef struct {
+	const char *name;           /**< Channel name                        */
+	char *buffer;               /**< Ring buffer                          */
+	uint32_t size;              /**< Ring buffer size                     */
+	volatile uint32_t wr_off;   /**< Written by target only               */
+	volatile uint32_t rd_off;   /**< Written by debugger only             */
+	uint32_t flags;             /**< Operating mode                       */
+} fault_rtt_buffer_t;
+
+/**
+ * \brief RTT control block with one up-buffer and no down-buffer
+ */
+typedef struct {
+	char id[16];                /**< #FAULT_SINK_RTT_ID                   */
+	int32_t max_up;             /**< Number of up-buffers                 */
+	int32_t max_down;           /**< Number of down-buffers               */
+	fault_rtt_buffer_t up[1];   /**< Up-buffer (target to host)           */
+	fault_rtt_buffer_t down[1]; /**< Down-buffer, unused                  */
+} fault_rtt_cb_t;
+
+extern fault_rtt_cb_t fault_rtt_cb;
+
+extern const fault_sink_t fault_sink_semihost; /**< printf-family output, halts the core on each call */
+extern const fault_sink_t fault_sink_itm;      /**< ITM stimulus port 0 over SWO                      */
+extern const fault_sink_t fault_sink_rtt;      /**< RTT-style memory up-buffer read by the debugger   */
+extern const fault_sink_t fault_sink_uart;     /**< Polled UART, see fault_sink_uart_init()           */
+
+void fault_sink_uart_init(volatile uint32_t *data_reg, volatile uint32_t *status_reg, uint32_t tx_empty_mask, uint32_t tx_complete_mask);
+
+#endif
@@ -0,0 +1,242 @@
+/**
+ * \file
+ * \brief Fault path latency benchmark
+ *
+ * Built with FAULT_HANDLER_BENCH=1, main.c then drops out. Every test routine
+ * is faulted FAULT_BENCH_RUNS times through every sink; the handler
+ * redirects to a landing function that longjmps back here, and the cycles
+ * from trampoline entry to record commit and to output flush are reported.
+ * The ring is drained before each run so every record is a full capture;
+ * with FAULT_HANDLER_DEDUP each run faults a second time and the repeat,
+ * which only bumps the count of the stored record, is reported on its own.
+ *
+ * The report goes to FAULT_BENCH_REPORT_SINK when all runs are done.
+ */
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include "fault_handler.h"
+
+#if FAULT_HANDLER_BENCH
+
+#if !FAULT_HANDLER_RECOVERY || FAULT_HANDLER_RESET_ON_FAULT
+#error The benchmark needs FAULT_HANDLER_RECOVERY, without FAULT_HANDLER_RESET_ON_FAULT
+#endif
+
+#ifndef FAULT_BENCH_RUNS
+#define FAULT_BENCH_RUNS            16
+#endif
+
+#ifndef FAULT_BENCH_REPORT_SINK
+#define FAULT_BENCH_REPORT_SINK     fault_sink_semihost
+#endif
+
+#define DEMCR               (*((volatile uint32_t *)0xE000EDFCUL)) /**< Debug Exception and Monitor Control Register */
+#define DEMCR_TRCENA        ((uint32_t)0x01000000)                 /**< DWT and ITM enable */
+#define DWT_CTRL            (*((volatile uint32_t *)0xE0001000UL)) /**< DWT Control Register */
+#define DWT_CYCCNT          (*((volatile uint32_t *)0xE0001004UL)) /**< DWT cycle counter */
+#define DWT_CTRL_CYCCNTENA  ((uint32_t)0x00000001)                 /**< Cycle counter enable */
+
+/** Faults per run: the full capture, then its deduplicated repeat */
+#define BENCH_PASSES        (FAULT_HANDLER_DEDUP ? 2 : 1)
+
+/** All CFSR causes with a frame to return through */
+#define BENCH_CAUSES        0x030F0703UL
+
+/**
+ * \brief min, max and sum of one interval
+ */
+typedef struct {
+	uint32_t min;
+	uint32_t max;
+	uint32_t sum;
+} bench_stat_t;
+
+/**
+ * \brief Results of one test routine through one sink
+ */
+typedef struct {
+	uint32_t faults;        /**< Runs that faulted                  */
+	uint32_t repeats;       /**< Repeats that faulted               */
+	bench_stat_t record;    /**< Trampoline entry to record commit   */
+	bench_stat_t output;    /**< Trampoline entry to output flushed */
+	bench_stat_t dedup;     /**< Trampoline entry to repeat counted  */
+} bench_result_t;
+
+typedef struct {
+	const char *name;
+	uint32_t (*run)(void);
+} bench_test_t;
+
+/*
+ * Private Functions
+ */
+static void BenchLanding(void);
+static void BenchAdd(bench_stat_t *stat, uint32_t cycles);
+static void BenchReport(void);
+static void BenchLine(const char *test, const char *sink, const char *point, const bench_stat_t *stat, uint32_t n);
+static uint32_t RunBusFault(void);
+static uint32_t RunDivideByZero(void);
+static uint32_t RunNullFunction(void);
+static uint32_t RunDanglingPointer(void);
+static uint32_t RunDanglingPointer2(void);
+static uint32_t NullWrite(const void *buf, uint32_t len);
+static void NullFlush(void);
+
+/** Formatting cost alone, no transport */
+static const fault_sink_t nullSink = { NullWrite, NullFlush };
+
+static const bench_test_t tests[] = {
+	{ "bus_fault_code",        RunBusFault },
+	{ "divide_by_zero",        RunDivideByZero },
+	{ "call_to_null_function", RunNullFunction },
+	{ "dangling_pointer",      RunDanglingPointer },
+	{ "dangling_pointer2",     RunDanglingPointer2 },
+};
+
+static const struct {
+	const char *name;
+	const fault_sink_t *sink;
+} sinks[] = {
+	{ "null",     &nullSink },
+	{ "itm",      &fault_sink_itm },
+	{ "rtt",      &fault_sink_rtt },
+	{ "semihost", &fault_sink_semihost },
+};
+
+#define TEST_COUNT  (sizeof(tests) / sizeof(tests[0]))
+#define SINK_COUNT  (sizeof(sinks) / sizeof(sinks[0]))
+
+/* Statics, not locals: bus_fault_code() overwrites the stack above it */
+static jmp_buf benchJmp;
+static bench_result_t results[TEST_COUNT][SINK_COUNT];
+static volatile uint32_t benchTest;
+static volatile uint32_t benchSink;
+static volatile uint32_t benchRun;
+static volatile uint32_t benchPass;
+static fault_record_t drained;
+
+
+int main(void)
+{
+	DEMCR |= DEMCR_TRCENA;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+	fault_handler_boot_check();
+	fault_handler_set_policy(BENCH_CAUSES, FAULT_ACTION_REDIRECT, BenchLanding);
+	memset(results, 0, sizeof(results));
+	for (benchTest = 0; benchTest < TEST_COUNT; benchTest++) {
+		for (benchSink = 0; benchSink < SINK_COUNT; benchSink++) {
+			results[benchTest][benchSink].record.min = 0xFFFFFFFFUL;
+			results[benchTest][benchSink].output.min = 0xFFFFFFFFUL;
+			results[benchTest][benchSink].dedup.min = 0xFFFFFFFFUL;
+		}
+	}
+
+	for (benchTest = 0; benchTest < TEST_COUNT; benchTest++) {
+		for (benchSink = 0; benchSink < SINK_COUNT; benchSink++) {
+			fault_handler_set_sink(sinks[benchSink].sink);
+			for (benchRun = 0; benchRun < FAULT_BENCH_RUNS; benchRun++) {
+				/* an earlier record would turn the capture into a repeat */
+				while (fault_handler_read_record(&drained)) {
+				}
+				for (benchPass = 0; benchPass < BENCH_PASSES; benchPass++) {
+					if (setjmp(benchJmp) == 0) {
+						tests[benchTest].run();
+						/* returned: this part does not fault on it */
+					} else {
+						bench_result_t *r = &results[benchTest][benchSink];
+						if (benchPass == 0) {
+							r->faults++;
+							BenchAdd(&r->record, fault_bench.record - fault_bench.entry);
+							BenchAdd(&r->output, fault_bench.output - fault_bench.entry);
+						} else {
+							r->repeats++;
+							BenchAdd(&r->dedup, fault_bench.record - fault_bench.entry);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	BenchReport();
+
+	while (1);
+}
+
+/**
+ * \brief Redirect target of every benchmarked fault, back to the run loop
+ */
+static void BenchLanding(void)
+{
+	longjmp(benchJmp, 1);
+}
+
+static void BenchAdd(bench_stat_t *stat, uint32_t cycles)
+{
+	if (cycles < stat->min) {
+		stat->min = cycles;
+	}
+	if (cycles > stat->max) {
+		stat->max = cycles;
+	}
+	stat->sum += cycles;
+}
+
+/**
+ * \brief Print one line per test, sink and interval, in cycles
+ */
+static void BenchReport(void)
+{
+	uint32_t t, k;
+	char line[96];
+
+	fault_handler_set_sink(&FAULT_BENCH_REPORT_SINK);
+	snprintf(line, sizeof(line), "%-22s %-9s %-7s %6s %8s %8s %8s\n", "test", "sink", "point", "faults", "min", "max", "mean");
+	fault_write(&FAULT_BENCH_REPORT_SINK, line, strlen(line));
+
+	for (t = 0; t < TEST_COUNT; t++) {
+		for (k = 0; k < SINK_COUNT; k++) {
+			const bench_result_t *r = &results[t][k];
+			BenchLine(tests[t].name, sinks[k].name, "record", &r->record, r->faults);
+			BenchLine(tests[t].name, sinks[k].name, "output", &r->output, r->faults);
+#if FAULT_HANDLER_DEDUP
+			BenchLine(tests[t].name, sinks[k].name, "dedup", &r->dedup, r->repeats);
+#endif
+		}
+	}
+	FAULT_BENCH_REPORT_SINK.flush();
+}
+
+static void BenchLine(const char *test, const char *sink, const char *point, const bench_stat_t *stat, uint32_t n)
+{
+	char line[96];
+
+	if (n == 0) {
+		snprintf(line, sizeof(line), "%-22s %-9s %-7s %6u %8s %8s %8s\n", test, sink, point, 0u, "-", "-", "-");
+	} else {
+		snprintf(line, sizeof(line), "%-22s %-9s %-7s %6u %8lu %8lu %8lu\n", test, sink, point, (unsigned)n,
+		         (unsigned long)stat->min, (unsigned long)stat->max, (unsigned long)(stat->sum / n));
+	}
+	fault_write(&FAULT_BENCH_REPORT_SINK, line, strlen(line));
+}
+
+static uint32_t RunBusFault(void)         { return bus_fault_code(); }
+static uint32_t RunDivideByZero(void)     { return divide_by_zero(); }
+static uint32_t RunNullFunction(void)     { return call_to_null_function(); }
+static uint32_t RunDanglingPointer(void)  { return dangling_pointer(); }
+static uint32_t RunDanglingPointer2(void) { return dangling_pointer2(); }
+
+static uint32_t NullWrite(const void *buf, uint32_t len)
+{
+	(void)buf;
+	return len;
+}
+
+static void NullFlush(void)
+{
+}
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * \file
+ * \brief ARMv6-M and ARMv8-M Baseline backend
+ *
+ * Cortex-M0/M0+/M1 and M23: every fault is a HardFault and the core has no
+ * fault status or address register, so the record holds only the frame, the
+ * context and what the handler derives from them. Nothing is cached.
+ */
+#include "fault_arch.h"
+
+#if !FAULT_ARCH_CFSR
+
+/*
+ * Private defines
+ */
+
+#if FAULT_HANDLER_ARCH == FAULT_ARCH_V8M_BASE
+#define EXC_RETURN_ES   ((uint32_t)0x00000001) /**< Exception taken to Secure state         */
+#define EXC_RETURN_DCRS ((uint32_t)0x00000020) /**< Clear: additional state context stacked */
+#define EXC_RETURN_S    ((uint32_t)0x00000040) /**< Frame on a Secure stack                 */
+
+#define FRAME_STATE_WORDS  10  /**< Integrity signature, reserved word, r4-r11 */
+#endif
+
+
+void fault_arch_init(void)
+{
+}
+
+uint32_t fault_arch_cfsr(void)
+{
+	return 0;
+}
+
+uint32_t fault_arch_hfsr(void)
+{
+	return 0;
+}
+
+void fault_arch_status(fault_record_t *rec)
+{
+	rec->mmfar = 0;
+	rec->bfar  = 0;
+	rec->afsr  = 0;
+	rec->shcsr = 0;
+}
+
+void fault_arch_clear(uint32_t cfsr, uint32_t hfsr)
+{
+	(void)cfsr;
+	(void)hfsr;
+}
+
+uint32_t *fault_arch_frame(uint32_t stack[], uint32_t excReturn)
+{
+#if FAULT_HANDLER_ARCH == FAULT_ARCH_V8M_BASE
+	/* MSP and PSP of the other state are banked: the trampoline read ours */
+	if (((excReturn & EXC_RETURN_S) != 0) != ((excReturn & EXC_RETURN_ES) != 0)) {
+		return 0;
+	}
+	if ((excReturn & EXC_RETURN_DCRS) == 0) {
+		return stack + FRAME_STATE_WORDS;
+	}
+#else
+	(void)excReturn;
+#endif
+	return stack;
+}
+
+void fault_arch_clean(const volatile void *addr, uint32_t len)
+{
+	(void)addr;
+	(void)len;
+}
+#endif
@@ -0,0 +1,128 @@
+/**
+ * \file
+ * \brief ARMv7-M and ARMv8-M Mainline backend
+ *
+ * Cortex-M3/M4/M7 and M33/M55: the configurable fault status registers,
+ * the D-cache of the M7 and M55 and, on ARMv8-M, the SecureFault status
+ * and the stack limit registers.
+ */
+#include "fault_arch.h"
+
+#if FAULT_ARCH_CFSR
+
+/*
+ * Private defines
+ */
+
+#define SCB_CCR         (*(volatile uint32_t *)0xE000ED14UL)  /**< Configuration Control Register    */
+#define SCB_SHCSR       (*(volatile uint32_t *)0xE000ED24UL)  /**< System Handler Control and State  */
+#define SCB_CFSR        (*(volatile uint32_t *)0xE000ED28UL)  /**< Configurable Fault Status         */
+#define SCB_HFSR        (*(volatile uint32_t *)0xE000ED2CUL)  /**< HardFault Status                  */
+#define SCB_MMFAR       (*(volatile uint32_t *)0xE000ED34UL)  /**< MemManage Fault Address           */
+#define SCB_BFAR        (*(volatile uint32_t *)0xE000ED38UL)  /**< BusFault Address                  */
+#define SCB_AFSR        (*(volatile uint32_t *)0xE000ED3CUL)  /**< Auxiliary Fault Status            */
+#define SCB_DCCMVAC     (*(volatile uint32_t *)0xE000EF68UL)  /**< D-cache clean by address to PoC   */
+
+#define SCB_CCR_STKOFHFNMIGN  ((uint32_t)0x00000400) /**< No stack limit checks at negative priority */
+#define SCB_CCR_DC            ((uint32_t)0x00010000) /**< D-cache enabled */
+
+#if FAULT_ARCH_V8M
+#define SAU_SFSR        (*(volatile uint32_t *)0xE000EDE4UL)  /**< Secure Fault Status, RAZ from Non-secure */
+#define SAU_SFAR        (*(volatile uint32_t *)0xE000EDE8UL)  /**< Secure Fault Address                     */
+
+#define EXC_RETURN_ES   ((uint32_t)0x00000001) /**< Exception taken to Secure state         */
+#define EXC_RETURN_DCRS ((uint32_t)0x00000020) /**< Clear: additional state context stacked */
+#define EXC_RETURN_S    ((uint32_t)0x00000040) /**< Frame on a Secure stack                 */
+
+#define FRAME_STATE_WORDS  10  /**< Integrity signature, reserved word, r4-r11 */
+#endif
+
+#define DSB()           __asm volatile("DSB")
+#define ISB()           __asm volatile("ISB")
+
+
+void fault_arch_init(void)
+{
+#if FAULT_ARCH_V8M
+	SCB_CCR |= SCB_CCR_STKOFHFNMIGN;
+	DSB();
+	ISB();
+#endif
+}
+
+uint32_t fault_arch_cfsr(void)
+{
+	return SCB_CFSR;
+}
+
+uint32_t fault_arch_hfsr(void)
+{
+	return SCB_HFSR;
+}
+
+void fault_arch_status(fault_record_t *rec)
+{
+	rec->mmfar = SCB_MMFAR;
+	rec->bfar  = SCB_BFAR;
+	rec->afsr  = SCB_AFSR;
+	rec->shcsr = SCB_SHCSR;
+#if FAULT_ARCH_V8M
+	{
+		uint32_t msplim, psplim;
+
+		__asm volatile("MRS %0, MSPLIM" : "=r" (msplim));
+		__asm volatile("MRS %0, PSPLIM" : "=r" (psplim));
+		rec->sfsr   = SAU_SFSR;
+		rec->sfar   = SAU_SFAR;
+		rec->msplim = msplim;
+		rec->psplim = psplim;
+		rec->flags |= FAULT_FLAG_V8M;
+	}
+#endif
+}
+
+void fault_arch_clear(uint32_t cfsr, uint32_t hfsr)
+{
+	SCB_CFSR = cfsr;
+	SCB_HFSR = hfsr;
+	DSB();
+}
+
+uint32_t *fault_arch_frame(uint32_t stack[], uint32_t excReturn)
+{
+#if FAULT_ARCH_V8M
+	/* MSP and PSP of the other state are banked: the trampoline read ours */
+	if (((excReturn & EXC_RETURN_S) != 0) != ((excReturn & EXC_RETURN_ES) != 0)) {
+		return 0;
+	}
+	if ((excReturn & EXC_RETURN_DCRS) == 0) {
+		return stack + FRAME_STATE_WORDS;
+	}
+#else
+	(void)excReturn;
+#endif
+	return stack;
+}
+
+void fault_arch_clean(const volatile void *addr, uint32_t len)
+{
+#if FAULT_HANDLER_DCACHE
+	uintptr_t line = (uintptr_t)addr & ~(uintptr_t)(FAULT_HANDLER_DCACHE_LINE - 1);
+	uintptr_t end = (uintptr_t)addr + len;
+
+	if ((SCB_CCR & SCB_CCR_DC) == 0) {
+		return;
+	}
+
+	DSB();
+	for (; line < end; line += FAULT_HANDLER_DCACHE_LINE) {
+		SCB_DCCMVAC = (uint32_t)line;
+	}
+	DSB();
+	ISB();
+#else
+	(void)addr;
+	(void)len;
+#endif
+}
+#endif
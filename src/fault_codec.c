@@ -0,0 +1,541 @@
+/**
+ * \file
+ * \brief Compact crash record encoding
+ *
+ * Shared by the handler and the host decoder. The encoder is one forward
+ * pass over the record into a caller buffer, the 16-bit length being
+ * patched once the payload is written; no heap, no libc.
+ */
+#include <string.h>
+#include "fault_codec.h"
+#include "fault_crc.h"
+
+/*
+ * Private defines
+ */
+
+#define HFSR_VECTTBL        0x00000002UL
+#define HFSR_FORCED         0x40000000UL
+#define HFSR_DEBUGEVT       0x80000000UL
+#define CFSR_MMARVALID      0x00000080UL
+#define CFSR_BFARVALID      0x00008000UL
+#define SFSR_SFARVALID      0x00000040UL
+
+/* HFSR cause mask, bit 3 means the full register follows */
+#define MASK_VECTTBL        0x01
+#define MASK_FORCED         0x02
+#define MASK_DEBUGEVT       0x04
+#define MASK_OTHER          0x08
+
+typedef struct {
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t pos;
+} writer_t;
+
+typedef struct {
+	const uint8_t *buf;
+	uint32_t end;
+	uint32_t pos;
+	bool error;
+} reader_t;
+
+/*
+ * Private Functions
+ */
+static void PutByte(writer_t *w, uint8_t b);
+static void PutVarint(writer_t *w, uint32_t value);
+static void PutDelta(writer_t *w, uint32_t value, uint32_t base);
+#if FAULT_HANDLER_FPU
+static void PutWord(writer_t *w, uint32_t value);
+#endif
+static uint32_t GetVarint(reader_t *r);
+static uint32_t GetDelta(reader_t *r, uint32_t base);
+static uint32_t GetWord(reader_t *r);
+#if FAULT_HANDLER_RTOS
+static void PutTask(writer_t *w, const fault_task_record_t *task);
+#endif
+static void GetTask(reader_t *r, fault_task_record_t *task);
+
+
+/**
+ * \brief Encode a record
+ *
+ * \param rec crash record
+ * \param buf output, #FAULT_CODEC_MAX_SIZE bytes always suffice
+ * \param size size of \p buf
+ * \return encoded size, 0 if \p buf is too small
+ */
+uint32_t fault_record_encode(const fault_record_t *rec, uint8_t *buf, uint32_t size)
+{
+	writer_t w;
+	uint32_t mask = 0, i, n;
+
+	w.buf = buf;
+	w.size = size;
+	w.pos = 0;
+
+	PutByte(&w, FAULT_CODEC_SYNC0);
+	PutByte(&w, FAULT_CODEC_SYNC1);
+	PutByte(&w, FAULT_CODEC_VERSION);
+	PutByte(&w, 0);
+	PutByte(&w, 0);
+
+	PutVarint(&w, rec->seq);
+	PutVarint(&w, rec->flags);
+	PutVarint(&w, rec->exception);
+	PutVarint(&w, rec->action);
+	PutVarint(&w, rec->signature);
+	PutVarint(&w, rec->count);
+	PutVarint(&w, rec->last_seq - rec->seq);
+	PutVarint(&w, rec->boot);
+	PutVarint(&w, rec->uptime);
+#if FAULT_HANDLER_HOOKS > 0
+	if ((rec->flags & FAULT_FLAG_HOOK_OVERRUN) != 0) {
+		PutVarint(&w, rec->hook_overrun);
+	}
+#endif
+
+	if ((rec->hfsr & HFSR_VECTTBL) != 0) {
+		mask |= MASK_VECTTBL;
+	}
+	if ((rec->hfsr & HFSR_FORCED) != 0) {
+		mask |= MASK_FORCED;
+	}
+	if ((rec->hfsr & HFSR_DEBUGEVT) != 0) {
+		mask |= MASK_DEBUGEVT;
+	}
+	if ((rec->hfsr & ~(HFSR_VECTTBL | HFSR_FORCED | HFSR_DEBUGEVT)) != 0) {
+		mask |= MASK_OTHER;
+	}
+	PutByte(&w, (uint8_t)mask);
+	if ((mask & MASK_OTHER) != 0) {
+		PutVarint(&w, rec->hfsr);
+	}
+
+	PutVarint(&w, rec->cfsr);
+	if ((rec->cfsr & CFSR_MMARVALID) != 0) {
+		PutVarint(&w, rec->mmfar);
+	}
+	if ((rec->cfsr & CFSR_BFARVALID) != 0) {
+		PutVarint(&w, rec->bfar);
+	}
+	PutVarint(&w, rec->afsr);
+	PutVarint(&w, rec->shcsr);
+#if FAULT_ARCH_V8M
+	if ((rec->flags & FAULT_FLAG_V8M) != 0) {
+		PutVarint(&w, rec->sfsr);
+		if ((rec->sfsr & SFSR_SFARVALID) != 0) {
+			PutVarint(&w, rec->sfar);
+		}
+		PutVarint(&w, rec->msplim);
+		PutVarint(&w, rec->psplim);
+	}
+#endif
+
+	PutVarint(&w, rec->r0);
+	PutVarint(&w, rec->r1);
+	PutVarint(&w, rec->r2);
+	PutVarint(&w, rec->r3);
+	PutVarint(&w, rec->r12);
+	PutVarint(&w, rec->pc);
+	PutDelta(&w, rec->lr, rec->pc);
+	PutVarint(&w, rec->psr);
+	PutVarint(&w, ~rec->exc_return);
+
+	if ((rec->flags & FAULT_FLAG_CONTEXT) != 0) {
+		PutVarint(&w, rec->r4);
+		PutVarint(&w, rec->r5);
+		PutVarint(&w, rec->r6);
+		PutVarint(&w, rec->r7);
+		PutVarint(&w, rec->r8);
+		PutVarint(&w, rec->r9);
+		PutVarint(&w, rec->r10);
+		PutVarint(&w, rec->r11);
+		PutVarint(&w, rec->msp);
+		PutDelta(&w, rec->psp, rec->msp);
+	}
+
+#if FAULT_HANDLER_FPU
+	if ((rec->flags & FAULT_FLAG_FP_REGS) != 0) {
+		PutVarint(&w, rec->fpscr);
+		for (i = 0; i < 16; i++) {
+			PutWord(&w, rec->s[i]);
+		}
+	}
+#endif
+
+#if FAULT_HANDLER_BACKTRACE_DEPTH > 0
+	n = (rec->backtrace_count < FAULT_HANDLER_BACKTRACE_DEPTH) ? rec->backtrace_count : FAULT_HANDLER_BACKTRACE_DEPTH;
+	PutVarint(&w, n);
+	for (i = 0; i < n; i++) {
+		PutDelta(&w, rec->backtrace[i], rec->pc);
+	}
+#else
+	PutVarint(&w, 0);
+#endif
+
+#if FAULT_HANDLER_STACK_SNAPSHOT > 0
+	n = (rec->snapshot_count < FAULT_HANDLER_STACK_SNAPSHOT) ? rec->snapshot_count : FAULT_HANDLER_STACK_SNAPSHOT;
+	PutVarint(&w, n);
+	if (n > 0) {
+		PutVarint(&w, rec->snapshot_addr);
+		for (i = 0; i < n; i++) {
+			PutVarint(&w, rec->snapshot[i]);
+		}
+	}
+#else
+	PutVarint(&w, 0);
+#endif
+
+#if FAULT_HANDLER_RTOS
+	if ((rec->flags & FAULT_FLAG_TASK) != 0) {
+		PutTask(&w, &rec->task);
+	}
+	n = (rec->task_count < FAULT_HANDLER_RTOS_TASKS) ? rec->task_count : FAULT_HANDLER_RTOS_TASKS;
+	PutVarint(&w, n);
+	for (i = 0; i < n; i++) {
+		PutTask(&w, &rec->tasks[i]);
+	}
+#endif
+	(void)i;
+	(void)n;
+
+	if (w.pos + FAULT_CODEC_TRAILER > w.size || w.pos - FAULT_CODEC_HEADER > 0xFFFF) {
+		return 0;
+	}
+	buf[3] = (uint8_t)(w.pos - FAULT_CODEC_HEADER);
+	buf[4] = (uint8_t)((w.pos - FAULT_CODEC_HEADER) >> 8);
+
+	n = fault_crc32_bytes(buf, w.pos);
+	for (i = 0; i < FAULT_CODEC_TRAILER; i++) {
+		PutByte(&w, (uint8_t)(n >> (8 * i)));
+	}
+	return w.pos;
+}
+
+/**
+ * \brief Decode one record
+ *
+ * Arrays longer than this build keeps are truncated, missing parts read as
+ * zero.
+ *
+ * \param buf encoded bytes, starting with the sync bytes
+ * \param len bytes available
+ * \param out decoded record, magic set to #FAULT_RECORD_MAGIC
+ * \param used bytes consumed on success
+ * \return false if \p buf does not hold a complete, known record with a good CRC
+ */
+bool fault_record_decode(const uint8_t *buf, uint32_t len, fault_record_t *out, uint32_t *used)
+{
+	reader_t r;
+	uint32_t mask = 0, i, n, crc;
+
+	if (len < FAULT_CODEC_HEADER || buf[0] != FAULT_CODEC_SYNC0 || buf[1] != FAULT_CODEC_SYNC1 ||
+	    buf[2] != FAULT_CODEC_VERSION) {
+		return false;
+	}
+
+	r.buf = buf;
+	r.pos = FAULT_CODEC_HEADER;
+	r.end = FAULT_CODEC_HEADER + (buf[3] | ((uint32_t)buf[4] << 8));
+	r.error = false;
+	if (r.end + FAULT_CODEC_TRAILER > len) {
+		return false;
+	}
+	crc = (uint32_t)buf[r.end] | ((uint32_t)buf[r.end + 1] << 8) |
+	      ((uint32_t)buf[r.end + 2] << 16) | ((uint32_t)buf[r.end + 3] << 24);
+	if (crc != fault_crc32_bytes(buf, r.end)) {
+		return false;
+	}
+
+	memset(out, 0, sizeof(*out));
+
+	out->seq = GetVarint(&r);
+	out->flags = GetVarint(&r);
+	out->exception = GetVarint(&r);
+	out->action = GetVarint(&r);
+	out->signature = GetVarint(&r);
+	out->count = GetVarint(&r);
+	out->last_seq = out->seq + GetVarint(&r);
+	out->boot = GetVarint(&r);
+	out->uptime = GetVarint(&r);
+	if ((out->flags & FAULT_FLAG_HOOK_OVERRUN) != 0) {
+#if FAULT_HANDLER_HOOKS > 0
+		out->hook_overrun = GetVarint(&r);
+#else
+		GetVarint(&r);
+		out->flags &= ~FAULT_FLAG_HOOK_OVERRUN;
+#endif
+	}
+
+	if (r.pos < r.end) {
+		mask = r.buf[r.pos++];
+	}
+	if ((mask & MASK_OTHER) != 0) {
+		out->hfsr = GetVarint(&r);
+	} else {
+		out->hfsr = (((mask & MASK_VECTTBL) != 0) ? HFSR_VECTTBL : 0) |
+		            (((mask & MASK_FORCED) != 0) ? HFSR_FORCED : 0) |
+		            (((mask & MASK_DEBUGEVT) != 0) ? HFSR_DEBUGEVT : 0);
+	}
+
+	out->cfsr = GetVarint(&r);
+	if ((out->cfsr & CFSR_MMARVALID) != 0) {
+		out->mmfar = GetVarint(&r);
+	}
+	if ((out->cfsr & CFSR_BFARVALID) != 0) {
+		out->bfar = GetVarint(&r);
+	}
+	out->afsr = GetVarint(&r);
+	out->shcsr = GetVarint(&r);
+	if ((out->flags & FAULT_FLAG_V8M) != 0) {
+#if FAULT_ARCH_V8M
+		out->sfsr = GetVarint(&r);
+		if ((out->sfsr & SFSR_SFARVALID) != 0) {
+			out->sfar = GetVarint(&r);
+		}
+		out->msplim = GetVarint(&r);
+		out->psplim = GetVarint(&r);
+#else
+		if ((GetVarint(&r) & SFSR_SFARVALID) != 0) {
+			GetVarint(&r);
+		}
+		GetVarint(&r);
+		GetVarint(&r);
+		out->flags &= ~FAULT_FLAG_V8M;
+#endif
+	}
+
+	out->r0 = GetVarint(&r);
+	out->r1 = GetVarint(&r);
+	out->r2 = GetVarint(&r);
+	out->r3 = GetVarint(&r);
+	out->r12 = GetVarint(&r);
+	out->pc = GetVarint(&r);
+	out->lr = GetDelta(&r, out->pc);
+	out->psr = GetVarint(&r);
+	out->exc_return = ~GetVarint(&r);
+
+	if ((out->flags & FAULT_FLAG_CONTEXT) != 0) {
+		out->r4 = GetVarint(&r);
+		out->r5 = GetVarint(&r);
+		out->r6 = GetVarint(&r);
+		out->r7 = GetVarint(&r);
+		out->r8 = GetVarint(&r);
+		out->r9 = GetVarint(&r);
+		out->r10 = GetVarint(&r);
+		out->r11 = GetVarint(&r);
+		out->msp = GetVarint(&r);
+		out->psp = GetDelta(&r, out->msp);
+	}
+
+	if ((out->flags & FAULT_FLAG_FP_REGS) != 0) {
+#if FAULT_HANDLER_FPU
+		out->fpscr = GetVarint(&r);
+		for (i = 0; i < 16; i++) {
+			out->s[i] = GetWord(&r);
+		}
+#else
+		GetVarint(&r);
+		for (i = 0; i < 16; i++) {
+			GetWord(&r);
+		}
+		out->flags &= ~FAULT_FLAG_FP_REGS;
+#endif
+	}
+
+	n = GetVarint(&r);
+	for (i = 0; i < n && !r.error; i++) {
+		uint32_t addr = GetDelta(&r, out->pc);
+#if FAULT_HANDLER_BACKTRACE_DEPTH > 0
+		if (i < FAULT_HANDLER_BACKTRACE_DEPTH) {
+			out->backtrace[i] = addr;
+			out->backtrace_count = i + 1;
+		}
+#else
+		(void)addr;
+#endif
+	}
+
+	n = GetVarint(&r);
+	if (n > 0) {
+		uint32_t addr = GetVarint(&r);
+#if FAULT_HANDLER_STACK_SNAPSHOT > 0
+		out->snapshot_addr = addr;
+#else
+		(void)addr;
+#endif
+		for (i = 0; i < n && !r.error; i++) {
+			uint32_t word = GetVarint(&r);
+#if FAULT_HANDLER_STACK_SNAPSHOT > 0
+			if (i < FAULT_HANDLER_STACK_SNAPSHOT) {
+				out->snapshot[i] = word;
+				out->snapshot_count = i + 1;
+			}
+#else
+			(void)word;
+#endif
+		}
+	}
+
+	/* optional task section, absent from builds without an RTOS */
+	if (r.pos < r.end) {
+		fault_task_record_t task;
+
+		if ((out->flags & FAULT_FLAG_TASK) != 0) {
+			GetTask(&r, &task);
+#if FAULT_HANDLER_RTOS
+			out->task = task;
+#endif
+		}
+		n = GetVarint(&r);
+		for (i = 0; i < n && !r.error; i++) {
+			GetTask(&r, &task);
+#if FAULT_HANDLER_RTOS
+			if (i < FAULT_HANDLER_RTOS_TASKS) {
+				out->tasks[i] = task;
+				out->task_count = i + 1;
+			}
+#endif
+		}
+	}
+#if !FAULT_HANDLER_RTOS
+	out->flags &= ~FAULT_FLAG_TASK;
+#endif
+
+	if (r.error) {
+		return false;
+	}
+
+	out->magic = FAULT_RECORD_MAGIC;
+	*used = r.end + FAULT_CODEC_TRAILER;
+	return true;
+}
+
+/*
+ * Private Functions
+ */
+
+static void PutByte(writer_t *w, uint8_t b)
+{
+	if (w->pos < w->size) {
+		w->buf[w->pos] = b;
+	}
+	w->pos++;
+}
+
+/**
+ * \brief LEB128: 7 bits per byte, low first, bit 7 set on all but the last
+ */
+static void PutVarint(writer_t *w, uint32_t value)
+{
+	while (value >= 0x80) {
+		PutByte(w, (uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	PutByte(w, (uint8_t)value);
+}
+
+/**
+ * \brief Zigzag-encoded signed difference, small for nearby addresses
+ */
+static void PutDelta(writer_t *w, uint32_t value, uint32_t base)
+{
+	uint32_t d = value - base;
+
+	PutVarint(w, (d << 1) ^ (uint32_t)-(int32_t)(d >> 31));
+}
+
+#if FAULT_HANDLER_FPU
+static void PutWord(writer_t *w, uint32_t value)
+{
+	PutByte(w, (uint8_t)value);
+	PutByte(w, (uint8_t)(value >> 8));
+	PutByte(w, (uint8_t)(value >> 16));
+	PutByte(w, (uint8_t)(value >> 24));
+}
+#endif
+
+static uint32_t GetVarint(reader_t *r)
+{
+	uint32_t value = 0, shift = 0;
+
+	while (r->pos < r->end && shift < 35) {
+		uint8_t b = r->buf[r->pos++];
+		value |= (uint32_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) {
+			return value;
+		}
+		shift += 7;
+	}
+	r->error = true;
+	return 0;
+}
+
+static uint32_t GetDelta(reader_t *r, uint32_t base)
+{
+	uint32_t z = GetVarint(r);
+
+	return base + ((z >> 1) ^ (uint32_t)-(int32_t)(z & 1));
+}
+
+static uint32_t GetWord(reader_t *r)
+{
+	uint32_t value;
+
+	if (r->end - r->pos < 4) {
+		r->error = true;
+		r->pos = r->end;
+		return 0;
+	}
+	value = (uint32_t)r->buf[r->pos] | ((uint32_t)r->buf[r->pos + 1] << 8) |
+	        ((uint32_t)r->buf[r->pos + 2] << 16) | ((uint32_t)r->buf[r->pos + 3] << 24);
+	r->pos += 4;
+	return value;
+}
+
+#if FAULT_HANDLER_RTOS
+/**
+ * \brief Task entry: base as a delta against sp, unused biased so that
+ * FAULT_TASK_UNKNOWN takes one byte, name length-prefixed
+ */
+static void PutTask(writer_t *w, const fault_task_record_t *task)
+{
+	uint32_t len = 0, i;
+
+	PutVarint(w, task->id);
+	PutVarint(w, task->sp);
+	PutDelta(w, task->base, task->sp);
+	PutVarint(w, task->unused + 1);
+	while (len < FAULT_TASK_NAME_SIZE && task->name[len] != '\0') {
+		len++;
+	}
+	PutByte(w, (uint8_t)len);
+	for (i = 0; i < len; i++) {
+		PutByte(w, (uint8_t)task->name[i]);
+	}
+}
+#endif
+
+static void GetTask(reader_t *r, fault_task_record_t *task)
+{
+	uint32_t len, i;
+
+	memset(task, 0, sizeof(*task));
+	task->id = GetVarint(r);
+	task->sp = GetVarint(r);
+	task->base = GetDelta(r, task->sp);
+	task->unused = GetVarint(r) - 1;
+	len = (r->pos < r->end) ? r->buf[r->pos++] : 0;
+	if (len > r->end - r->pos) {
+		r->error = true;
+		return;
+	}
+	for (i = 0; i < len; i++) {
+		uint8_t c = r->buf[r->pos++];
+		if (i < FAULT_TASK_NAME_SIZE) {
+			task->name[i] = (char)c;
+		}
+	}
+}
@@ -0,0 +1,322 @@
+/**
+ * \file
+ * \brief Streaming ELF core file exporter
+ *
+ * The file is never built: every call to fault_core_write() walks its
+ * parts from the start, regenerates the header the cursor is in and hands
+ * the sink a pointer into it, or straight into the dumped region. The cost
+ * is a few dozen stores per call, and the exporter needs no buffer but
+ * the largest header.
+ */
+#include <string.h>
+#include "fault_core.h"
+
+#if FAULT_HANDLER_CORE
+
+/*
+ * Private defines
+ */
+
+#define ET_CORE         4           /**< Core file                       */
+#define EM_ARM          40          /**< ARM                             */
+#define EF_ARM_EABI_VER5 0x05000000UL /**< EABI version 5                */
+#define PT_LOAD         1           /**< Loadable segment                */
+#define PT_NOTE         4           /**< Note segment                    */
+#define PF_W            2           /**< Writable                        */
+#define PF_R            4           /**< Readable                        */
+#define NT_PRSTATUS     1           /**< Registers note                  */
+
+#define PRSTATUS_SIZE   148         /**< ARM elf_prstatus                */
+#define PRSTATUS_CURSIG 12          /**< pr_cursig offset                */
+#define PRSTATUS_PID    24          /**< pr_pid offset                   */
+#define PRSTATUS_REG    72          /**< pr_reg offset, 18 words         */
+
+#define SIGILL          4
+#define SIGBUS          7
+#define SIGFPE          8
+#define SIGSEGV         11
+
+#define EXC_RETURN_SPSEL        ((uint32_t)0x00000004) /**< Frame on PSP                            */
+#define EXC_RETURN_DCRS         ((uint32_t)0x00000020) /**< Clear: additional state context stacked */
+#define CFSR_DIVBYZERO          ((uint32_t)0x02000000) /**< UsageFault divide by zero               */
+#define PSR_STKALIGN            ((uint32_t)0x00000200) /**< Frame realigned by one word             */
+
+/** Parts before the region contents: ELF header, program headers, note */
+#define CORE_HEADER_PARTS(n)    ((n) + 3)
+
+/*
+ * Private Functions
+ */
+static uint32_t CorePart(const fault_record_t *rec, uint32_t index, const uint8_t **data);
+static uint32_t RegionOffset(uint32_t region);
+static void Prstatus(const fault_record_t *rec, uint8_t *buf);
+static uint32_t CallerSp(const fault_record_t *rec);
+static void Put16(uint8_t *buf, uint32_t value);
+static void Put32(uint8_t *buf, uint32_t value);
+
+static const fault_core_region_t coreDefault = {
+	FAULT_HANDLER_RAM_START, FAULT_HANDLER_RAM_END - FAULT_HANDLER_RAM_START
+};
+
+static const fault_core_region_t *coreRegions = &coreDefault;
+static uint32_t coreRegionCount = 1;
+
+static uint8_t coreScratch[FAULT_CORE_NOTE_SIZE];
+
+
+/**
+ * \brief Select the memory dumped into the core file
+ *
+ * The table is not copied and must stay valid. By default the core holds
+ * #FAULT_HANDLER_RAM_START to #FAULT_HANDLER_RAM_END.
+ *
+ * \param regions table of regions, 0 for the default
+ * \param count entries of \p regions
+ */
+void fault_core_set_regions(const fault_core_region_t *regions, uint32_t count)
+{
+	if (regions != 0 && count != 0) {
+		coreRegions = regions;
+		coreRegionCount = count;
+	} else {
+		coreRegions = &coreDefault;
+		coreRegionCount = 1;
+	}
+}
+
+/**
+ * \brief Size in bytes of the core file with the current regions
+ */
+uint32_t fault_core_size(void)
+{
+	return RegionOffset(coreRegionCount);
+}
+
+/**
+ * \brief Start a core file of \p rec from its first byte
+ */
+void fault_core_begin(fault_core_cursor_t *cur, const fault_record_t *rec)
+{
+	cur->rec = rec;
+	cur->offset = 0;
+}
+
+/**
+ * \brief Send the core file from the cursor on, as far as the sink takes it
+ *
+ * Stops at the first write the sink accepts nothing of; calling again
+ * later goes on from there.
+ *
+ * \return true once the whole file is sent
+ */
+bool fault_core_write(fault_core_cursor_t *cur, const fault_sink_t *sink)
+{
+	uint32_t parts = CORE_HEADER_PARTS(coreRegionCount) + coreRegionCount;
+	uint32_t base = 0;
+	uint32_t index = 0;
+
+	while (index < parts) {
+		const uint8_t *data;
+		uint32_t len = CorePart(cur->rec, index, &data);
+
+		if (cur->offset < base + len) {
+			uint32_t sent = sink->write(data + (cur->offset - base), base + len - cur->offset);
+
+			if (sent == 0) {
+				return false;
+			}
+			cur->offset += sent;
+		} else {
+			base += len;
+			index++;
+		}
+	}
+	return true;
+}
+
+/*
+ * Private Functions
+ */
+
+/**
+ * \brief Bytes of part \p index of the core file
+ *
+ * Headers are built in coreScratch, region contents are returned in place.
+ *
+ * \param rec record the registers come from
+ * \param index part number
+ * \param data set to the first byte of the part
+ * \return length of the part
+ */
+static uint32_t CorePart(const fault_record_t *rec, uint32_t index, const uint8_t **data)
+{
+	uint32_t phnum = coreRegionCount + 1;
+	uint8_t *buf = coreScratch;
+
+	if (index >= CORE_HEADER_PARTS(coreRegionCount)) {
+		const fault_core_region_t *region = &coreRegions[index - CORE_HEADER_PARTS(coreRegionCount)];
+
+		*data = (const uint8_t *)(uintptr_t)region->start;
+		return region->size;
+	}
+
+	*data = buf;
+	memset(buf, 0, sizeof(coreScratch));
+
+	if (index == 0) {
+		buf[0] = 0x7F;
+		buf[1] = 'E';
+		buf[2] = 'L';
+		buf[3] = 'F';
+		buf[4] = 1;                              /* ELFCLASS32  */
+		buf[5] = 1;                              /* ELFDATA2LSB */
+		buf[6] = 1;                              /* EV_CURRENT  */
+		Put16(&buf[16], ET_CORE);
+		Put16(&buf[18], EM_ARM);
+		Put32(&buf[20], 1);
+		Put32(&buf[28], FAULT_CORE_EHDR_SIZE);   /* e_phoff     */
+		Put32(&buf[36], EF_ARM_EABI_VER5);
+		Put16(&buf[40], FAULT_CORE_EHDR_SIZE);
+		Put16(&buf[42], FAULT_CORE_PHDR_SIZE);
+		Put16(&buf[44], phnum);
+		return FAULT_CORE_EHDR_SIZE;
+	}
+
+	if (index == 1) {
+		Put32(&buf[0], PT_NOTE);
+		Put32(&buf[4], FAULT_CORE_EHDR_SIZE + phnum * FAULT_CORE_PHDR_SIZE);
+		Put32(&buf[16], FAULT_CORE_NOTE_SIZE);
+		Put32(&buf[24], PF_R);
+		Put32(&buf[28], 4);
+		return FAULT_CORE_PHDR_SIZE;
+	}
+
+	if (index <= phnum) {
+		const fault_core_region_t *region = &coreRegions[index - 2];
+
+		Put32(&buf[0], PT_LOAD);
+		Put32(&buf[4], RegionOffset(index - 2));
+		Put32(&buf[8], region->start);
+		Put32(&buf[12], region->start);
+		Put32(&buf[16], region->size);
+		Put32(&buf[20], region->size);
+		Put32(&buf[24], PF_R | PF_W);
+		Put32(&buf[28], 4);
+		return FAULT_CORE_PHDR_SIZE;
+	}
+
+	Put32(&buf[0], 5);                           /* namesz, "CORE" */
+	Put32(&buf[4], PRSTATUS_SIZE);
+	Put32(&buf[8], NT_PRSTATUS);
+	memcpy(&buf[12], "CORE", 4);
+	Prstatus(rec, &buf[20]);
+	return FAULT_CORE_NOTE_SIZE;
+}
+
+/**
+ * \brief File offset of the contents of region \p region, or the file size past the last
+ */
+static uint32_t RegionOffset(uint32_t region)
+{
+	uint32_t offset = FAULT_CORE_EHDR_SIZE + (coreRegionCount + 1) * FAULT_CORE_PHDR_SIZE + FAULT_CORE_NOTE_SIZE;
+	uint32_t i;
+
+	for (i = 0; i < region; i++) {
+		offset += coreRegions[i].size;
+	}
+	return offset;
+}
+
+/**
+ * \brief ARM elf_prstatus of \p rec: signal, pid 1 and r0-r15, xPSR, orig_r0
+ *
+ * r4-r11 are 0 without #FAULT_FLAG_CONTEXT, and sp is 0 when the record
+ * does not tell where the frame was.
+ */
+static void Prstatus(const fault_record_t *rec, uint8_t *buf)
+{
+	uint8_t *reg = &buf[PRSTATUS_REG];
+	uint32_t sig;
+
+	switch (rec->exception) {
+	case 5:
+		sig = SIGBUS;
+		break;
+	case 6:
+		sig = ((rec->cfsr & CFSR_DIVBYZERO) != 0) ? SIGFPE : SIGILL;
+		break;
+	default:
+		sig = SIGSEGV;
+		break;
+	}
+	Put16(&buf[PRSTATUS_CURSIG], sig);
+	Put32(&buf[PRSTATUS_PID], 1);
+
+	Put32(&reg[0 * 4], rec->r0);
+	Put32(&reg[1 * 4], rec->r1);
+	Put32(&reg[2 * 4], rec->r2);
+	Put32(&reg[3 * 4], rec->r3);
+	if ((rec->flags & FAULT_FLAG_CONTEXT) != 0) {
+		Put32(&reg[4 * 4], rec->r4);
+		Put32(&reg[5 * 4], rec->r5);
+		Put32(&reg[6 * 4], rec->r6);
+		Put32(&reg[7 * 4], rec->r7);
+		Put32(&reg[8 * 4], rec->r8);
+		Put32(&reg[9 * 4], rec->r9);
+		Put32(&reg[10 * 4], rec->r10);
+		Put32(&reg[11 * 4], rec->r11);
+	}
+	Put32(&reg[12 * 4], rec->r12);
+	Put32(&reg[13 * 4], CallerSp(rec));
+	Put32(&reg[14 * 4], rec->lr);
+	Put32(&reg[15 * 4], rec->pc);
+	Put32(&reg[16 * 4], rec->psr);
+	Put32(&reg[17 * 4], rec->r0);
+}
+
+/**
+ * \brief sp of the faulting code, above the frame the core stacked
+ */
+static uint32_t CallerSp(const fault_record_t *rec)
+{
+	uint32_t sp;
+
+	if ((rec->flags & FAULT_FLAG_CONTEXT) != 0) {
+		sp = ((rec->exc_return & EXC_RETURN_SPSEL) != 0) ? rec->psp : rec->msp;
+#if FAULT_HANDLER_ARCH >= FAULT_ARCH_V8M_BASE
+		if ((rec->exc_return & EXC_RETURN_DCRS) == 0) {
+			sp += 10 * 4;
+		}
+#endif
+	} else {
+#if FAULT_HANDLER_STACK_SNAPSHOT > 0
+		sp = rec->snapshot_addr;
+#else
+		sp = 0;
+#endif
+	}
+
+	if (sp == 0 || (rec->flags & FAULT_FLAG_NO_FRAME) != 0) {
+		return sp;
+	}
+	sp += ((rec->flags & FAULT_FLAG_FP_FRAME) != 0) ? 26 * 4 : 8 * 4;
+	if ((rec->psr & PSR_STKALIGN) != 0) {
+		sp += 4;
+	}
+	return sp;
+}
+
+static void Put16(uint8_t *buf, uint32_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+}
+
+static void Put32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = (uint8_t)value;
+	buf[1] = (uint8_t)(value >> 8);
+	buf[2] = (uint8_t)(value >> 16);
+	buf[3] = (uint8_t)(value >> 24);
+}
+#endif
@@ -0,0 +1,153 @@
+/**
+ * \file
+ * \brief Fault status register decoding tables
+ *
+ * Single source of truth for the meaning of the CFSR, HFSR and, on ARMv8-M
+ * Mainline, SFSR bits, used by the on-target text dump and built unchanged
+ * into the host decoder. Set bits are walked with count-trailing-zeros, one
+ * table lookup per set bit.
+ */
+#include "fault_handler.h"
+#include "fault_decode.h"
+
+#if defined(__ICCARM__)
+#include <intrinsics.h>
+#endif
+
+#if FAULT_HANDLER_DECODE
+/** CFSR bits, indexed by bit number */
+const fault_bit_t fault_cfsr_bits[32] = {
+	/* MMFSR */
+	{ FAULT_CLASS_MEMMANAGE, FAULT_STR_IACCVIOL,    0 },                 /*  0 */
+	{ FAULT_CLASS_MEMMANAGE, FAULT_STR_DACCVIOL,    0 },                 /*  1 */
+	{ FAULT_CLASS_MEMMANAGE, FAULT_STR_NONE,        0 },                 /*  2 */
+	{ FAULT_CLASS_MEMMANAGE, FAULT_STR_UNSTKERR,    0 },                 /*  3 MUNSTKERR */
+	{ FAULT_CLASS_MEMMANAGE, FAULT_STR_STKERR,      0 },                 /*  4 MSTKERR */
+	{ FAULT_CLASS_MEMMANAGE, FAULT_STR_LSPERR,      0 },                 /*  5 MLSPERR */
+	{ FAULT_CLASS_MEMMANAGE, FAULT_STR_NONE,        0 },                 /*  6 */
+	{ FAULT_CLASS_MEMMANAGE, FAULT_STR_MMARVALID,   FAULT_BIT_ADDRESS }, /*  7 */
+	/* BFSR */
+	{ FAULT_CLASS_BUS,       FAULT_STR_IBUSERR,     0 },                 /*  8 */
+	{ FAULT_CLASS_BUS,       FAULT_STR_PRECISERR,   0 },                 /*  9 */
+	{ FAULT_CLASS_BUS,       FAULT_STR_IMPRECISERR, 0 },                 /* 10 */
+	{ FAULT_CLASS_BUS,       FAULT_STR_UNSTKERR,    0 },                 /* 11 */
+	{ FAULT_CLASS_BUS,       FAULT_STR_STKERR,      0 },                 /* 12 */
+	{ FAULT_CLASS_BUS,       FAULT_STR_LSPERR,      0 },                 /* 13 */
+	{ FAULT_CLASS_BUS,       FAULT_STR_NONE,        0 },                 /* 14 */
+	{ FAULT_CLASS_BUS,       FAULT_STR_BFARVALID,   FAULT_BIT_ADDRESS }, /* 15 */
+	/* UFSR */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_UNDEFINSTR,  0 },                 /* 16 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_INVSTATE,    0 },                 /* 17 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_INVPC,       0 },                 /* 18 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NOCP,        0 },                 /* 19 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_STKOF,       0 },                 /* 20 ARMv8-M */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NONE,        0 },                 /* 21 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NONE,        0 },                 /* 22 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NONE,        0 },                 /* 23 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_UNALIGNED,   0 },                 /* 24 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_DIVBYZERO,   0 },                 /* 25 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NONE,        0 },                 /* 26 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NONE,        0 },                 /* 27 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NONE,        0 },                 /* 28 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NONE,        0 },                 /* 29 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NONE,        0 },                 /* 30 */
+	{ FAULT_CLASS_USAGE,     FAULT_STR_NONE,        0 },                 /* 31 */
+};
+
+/** HFSR bits, indexed by bit number */
+const uint8_t fault_hfsr_bits[32] = {
+	FAULT_STR_NONE,   FAULT_STR_VECTTBL, FAULT_STR_NONE,   FAULT_STR_NONE,
+	FAULT_STR_NONE,   FAULT_STR_NONE,    FAULT_STR_NONE,   FAULT_STR_NONE,
+	FAULT_STR_NONE,   FAULT_STR_NONE,    FAULT_STR_NONE,   FAULT_STR_NONE,
+	FAULT_STR_NONE,   FAULT_STR_NONE,    FAULT_STR_NONE,   FAULT_STR_NONE,
+	FAULT_STR_NONE,   FAULT_STR_NONE,    FAULT_STR_NONE,   FAULT_STR_NONE,
+	FAULT_STR_NONE,   FAULT_STR_NONE,    FAULT_STR_NONE,   FAULT_STR_NONE,
+	FAULT_STR_NONE,   FAULT_STR_NONE,    FAULT_STR_NONE,   FAULT_STR_NONE,
+	FAULT_STR_NONE,   FAULT_STR_NONE,    FAULT_STR_FORCED, FAULT_STR_DEBUGEVT,
+};
+
+#if FAULT_ARCH_V8M
+/** SFSR bits, indexed by bit number */
+const uint8_t fault_sfsr_bits[8] = {
+	FAULT_STR_INVEP,  FAULT_STR_INVIS,   FAULT_STR_INVER,     FAULT_STR_AUVIOL,
+	FAULT_STR_INVTRAN, FAULT_STR_LSPERR, FAULT_STR_SFARVALID, FAULT_STR_LSERR,
+};
+#endif
+
+/** UFSR bits in the message order of the original handler, STKOF after NOCP */
+static const uint8_t usageOrder[16] = {
+	25, 17, 16, 18, 19, 20, 24, 21, 22, 23, 26, 27, 28, 29, 30, 31,
+};
+
+/** CFSR sub-registers, in print order */
+const fault_class_desc_t fault_classes[FAULT_CLASS_COUNT] = {
+	{ 0xFFFF0000UL, FAULT_STR_USAGE_TITLE,     0, usageOrder },
+	{ 0x0000FF00UL, FAULT_STR_BUS_TITLE,       1, 0 },
+	{ 0x000000FFUL, FAULT_STR_MEMMANAGE_TITLE, 1, 0 },
+};
+
+/** Message texts, each stored once */
+const char * const fault_strings[FAULT_STR_COUNT] = {
+	"",
+	"Usage fault: ",
+	"Bus fault: ",
+	"Memory Management (MPU) fault: ",
+	"Instruction access violation\n",
+	"Data access violation\n",
+	"Unstacking error\n",
+	"Stacking error\n",
+	"Lazy floating-point state preservation error\n",
+	"Memory Manage Address Register address valid flag\nMMFAR value = 0x",
+	"Instruction bus error\n",
+	"Precise data bus error\n",
+	"Imprecise data bus error\n",
+	"Bus Fault Address Register address valid flag\nBFAR value = 0x",
+	"The processor attempted to excecute an undefined instruction\n",
+	"Invalid combination of EPSR and instruction,\nsuch as calling a null pointer function\n",
+	"Attempt to load EXC_RETURN into pc illegally\n",
+	"Attempt to use a coprocessor instruction\n",
+	"Attempt to make an unaligned memory access\n",
+	"Divide by zero\n",
+	"Stack pointer below its limit register (MSPLIM/PSPLIM)\n",
+	"Vector table read fault\n",
+	"Forced Hard Fault\n",
+	"Debug event\n",
+#if FAULT_ARCH_V8M
+	"Secure fault: ",
+	"Invalid Secure state entry point\n",
+	"Invalid integrity signature on exception return\n",
+	"Invalid exception return\n",
+	"Attribution unit violation\n",
+	"Invalid transition from Secure to Non-secure state\n",
+	"Secure Fault Address Register address valid flag\nSFAR value = 0x",
+	"Lazy state activation or deactivation error\n",
+#endif
+};
+#endif
+
+/**
+ * \brief Count trailing zeros
+ *
+ * RBIT + CLZ on ARMv7-M and ARMv8-M Mainline, a plain loop elsewhere.
+ *
+ * \param value must not be 0
+ * \return index of the lowest set bit
+ */
+uint32_t fault_ctz(uint32_t value)
+{
+#if defined(__GNUC__) && !defined(__CC_ARM)
+	return (uint32_t)__builtin_ctz(value);
+#elif defined(__ICCARM__) && FAULT_ARCH_CFSR
+	return __CLZ(__RBIT(value));
+#elif defined(__CC_ARM) && FAULT_ARCH_CFSR
+	return __clz(__rbit(value));
+#else
+	uint32_t n = 0;
+
+	while ((value & 1) == 0) {
+		value >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
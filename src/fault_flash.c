@@ -0,0 +1,264 @@
+/**
+ * \file
+ * \brief Crash record persistence in pre-erased flash slots
+ *
+ * The pages of the application flash driver are used in rotation, each
+ * holding as many record slots as fit. The page after the current one is
+ * always kept erased: the boot path starts that erase and
+ * fault_flash_poll() completes it in the background, so the fault path only
+ * programs one slot. The slot magic is programmed last, a record cut by a
+ * reset is never seen as valid.
+ */
+#include <string.h>
+#include "fault_flash.h"
+#if FAULT_HANDLER_CRC
+#include "fault_crc.h"
+#endif
+
+/*
+ * Private defines
+ */
+
+#if FAULT_FLASH_UNIT != 4 && FAULT_FLASH_UNIT != 8
+#error FAULT_FLASH_UNIT must be 4 or 8
+#endif
+
+/** Record size rounded up to the program unit */
+#define SLOT_SIZE   ((sizeof(fault_record_t) + FAULT_FLASH_UNIT - 1) / FAULT_FLASH_UNIT * FAULT_FLASH_UNIT)
+
+/*
+ * Private Functions
+ */
+static bool SlotErased(uintptr_t addr);
+static bool PageErased(uint32_t page);
+static uintptr_t PageAddr(uint32_t page);
+static void Arm(void);
+
+static const fault_flash_t *flashDrv;
+static uint32_t slotsPerPage;
+static uint32_t flashPage;        /**< Page being filled                         */
+static uintptr_t flashNext;       /**< Next erased slot of flashPage, 0 if full  */
+static bool aheadReady;           /**< The page after flashPage is erased        */
+static bool erasing;              /**< Erase of the page ahead in progress       */
+
+
+/**
+ * \brief Find the newest record and arm the next slot
+ *
+ * Call it once at boot. The erase of the page ahead is only started, call
+ * fault_flash_poll() until it returns true to complete it.
+ *
+ * \param flash application flash driver, 0 to disable the backend
+ */
+void fault_flash_init(const fault_flash_t *flash)
+{
+	uint32_t page, slot, newest = 0;
+	bool found = false;
+
+	flashDrv = 0;
+	flashNext = 0;
+	aheadReady = false;
+	erasing = false;
+
+	if (flash == 0 || flash->page_count < 2 || flash->page_size / SLOT_SIZE == 0) {
+		return;
+	}
+	flashDrv = flash;
+	slotsPerPage = flash->page_size / SLOT_SIZE;
+	flashPage = 0;
+
+	for (page = 0; page < flash->page_count; page++) {
+		for (slot = 0; slot < slotsPerPage; slot++) {
+			const fault_record_t *rec = (const fault_record_t *)(PageAddr(page) + slot * SLOT_SIZE);
+			if (rec->magic == FAULT_RECORD_MAGIC && (!found || (int32_t)(rec->seq - newest) > 0)) {
+				newest = rec->seq;
+				flashPage = page;
+				found = true;
+			}
+		}
+	}
+
+	/* first slot after the last one not erased, interrupted writes included */
+	slot = slotsPerPage;
+	while (slot > 0 && SlotErased(PageAddr(flashPage) + (slot - 1) * SLOT_SIZE)) {
+		slot--;
+	}
+	if (slot < slotsPerPage) {
+		flashNext = PageAddr(flashPage) + slot * SLOT_SIZE;
+	}
+
+	Arm();
+}
+
+/**
+ * \brief Complete the background re-arm
+ *
+ * Call it from an idle loop or a low priority task after fault_flash_init()
+ * and after each persisted fault that resumed.
+ *
+ * \return true when the page ahead is erased and nothing is left to do
+ */
+bool fault_flash_poll(void)
+{
+	if (flashDrv == 0) {
+		return false;
+	}
+
+	if (erasing) {
+		if (flashDrv->busy()) {
+			return false;
+		}
+		erasing = false;
+		aheadReady = true;
+	}
+
+	Arm();
+	return aheadReady;
+}
+
+/**
+ * \brief Program a record into the next erased slot, fault path
+ *
+ * One slot is programmed, no erase and no page scan. Nothing is written
+ * while the background erase is still running: the record then only lives
+ * in the retained RAM ring.
+ *
+ * \param rec committed crash record
+ * \return true if the record was persisted
+ */
+bool fault_flash_store(const fault_record_t *rec)
+{
+	const uint8_t *src = (const uint8_t *)rec;
+	uint32_t body = (sizeof(fault_record_t) - FAULT_FLASH_UNIT) / FAULT_FLASH_UNIT * FAULT_FLASH_UNIT;
+	uintptr_t addr;
+	bool ok;
+
+	if (flashDrv == 0 || (erasing && flashDrv->busy())) {
+		return false;
+	}
+	/* the erase may have finished with no fault_flash_poll() since */
+	if (erasing) {
+		erasing = false;
+		aheadReady = true;
+	}
+	if (flashNext == 0 && aheadReady) {
+		flashPage = (flashPage + 1) % flashDrv->page_count;
+		flashNext = PageAddr(flashPage);
+		aheadReady = false;
+	}
+	addr = flashNext;
+	if (addr == 0) {
+		return false;
+	}
+
+	ok = flashDrv->program(addr + FAULT_FLASH_UNIT, src + FAULT_FLASH_UNIT, body);
+	if (ok && FAULT_FLASH_UNIT + body < sizeof(fault_record_t)) {
+		uint32_t tail[FAULT_FLASH_UNIT / 4];
+		uint32_t i;
+
+		for (i = 0; i < FAULT_FLASH_UNIT / 4; i++) {
+			tail[i] = FAULT_FLASH_ERASED;
+		}
+		memcpy(tail, src + FAULT_FLASH_UNIT + body, sizeof(fault_record_t) - FAULT_FLASH_UNIT - body);
+		ok = flashDrv->program(addr + FAULT_FLASH_UNIT + body, tail, FAULT_FLASH_UNIT);
+	}
+	/* the unit holding the magic goes last */
+	if (ok) {
+		ok = flashDrv->program(addr, src, FAULT_FLASH_UNIT);
+	}
+
+	/* the slot is used even on failure, never program it twice */
+	flashNext += SLOT_SIZE;
+	if (flashNext >= PageAddr(flashPage) + slotsPerPage * SLOT_SIZE) {
+		flashNext = 0;
+	}
+
+	return ok;
+}
+
+/**
+ * \brief Iterate over the persisted records, in flash order
+ *
+ * Records failing their CRC are skipped.
+ *
+ * \param cursor slot index, start with 0; updated past the returned record
+ * \param out where to copy the record
+ * \return false when there are no more records
+ */
+bool fault_flash_next(uint32_t *cursor, fault_record_t *out)
+{
+	if (flashDrv == 0) {
+		return false;
+	}
+
+	while (*cursor < flashDrv->page_count * slotsPerPage) {
+		uint32_t n = (*cursor)++;
+		const fault_record_t *rec = (const fault_record_t *)(PageAddr(n / slotsPerPage) + (n % slotsPerPage) * SLOT_SIZE);
+		if (rec->magic != FAULT_RECORD_MAGIC) {
+			continue;
+		}
+#if FAULT_HANDLER_CRC
+		/* programmed up to the magic, then a brown-out mid-program */
+		if (!fault_record_crc_ok(rec)) {
+			continue;
+		}
+#endif
+		memcpy(out, rec, sizeof(*out));
+		return true;
+	}
+	return false;
+}
+
+/**
+ * \brief Start erasing the page ahead, the oldest in the rotation, if needed
+ *
+ * The fault path moves to that page once the current one is full, so a full
+ * page stays readable until the next fault needs the room.
+ */
+static void Arm(void)
+{
+	uint32_t ahead;
+
+	if (erasing || aheadReady) {
+		return;
+	}
+
+	ahead = (flashPage + 1) % flashDrv->page_count;
+	if (PageErased(ahead)) {
+		aheadReady = true;
+	} else {
+		flashDrv->erase_start(PageAddr(ahead));
+		erasing = true;
+	}
+}
+
+static bool SlotErased(uintptr_t addr)
+{
+	const uint32_t *w = (const uint32_t *)addr;
+	uint32_t i;
+
+	for (i = 0; i < SLOT_SIZE / 4; i++) {
+		if (w[i] != FAULT_FLASH_ERASED) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool PageErased(uint32_t page)
+{
+	const uint32_t *w = (const uint32_t *)PageAddr(page);
+	uint32_t i;
+
+	for (i = 0; i < flashDrv->page_size / 4; i++) {
+		if (w[i] != FAULT_FLASH_ERASED) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static uintptr_t PageAddr(uint32_t page)
+{
+	return flashDrv->base + (uintptr_t)page * flashDrv->page_size;
+}
@@ -6,8 +6,21 @@
  * There are also some functions to generate exceptions, so you can call them
  * and have an idea of what help this module can give you!
  */
-#include <stdio.h>
 #include "fault_handler.h"
+#include "fault_arch.h"
+#include "fault_decode.h"
+#if FAULT_HANDLER_FLASH
+#include "fault_flash.h"
+#endif
+#if FAULT_HANDLER_COMPACT
+#include "fault_codec.h"
+#endif
+#if FAULT_HANDLER_CRC
+#include "fault_crc.h"
+#endif
+#if FAULT_HANDLER_CORE
+#include "fault_core.h"
+#endif
 
 /*
  * Private defines
@@ -15,6 +28,62 @@
 
 #define     __IO    volatile      /*!< defines 'read / write' permissions   */
 #define     __I    volatile       /*!< defines 'read only' permissions   */
+
+/* C entry points referenced only from the trampolines must survive LTO */
+#if defined(__GNUC__) && !defined(__CC_ARM)
+#define FAULT_USED  __attribute__((used))
+#else
+#define FAULT_USED
+#endif
+
+#define FAULT_STR(x)    #x
+#define FAULT_XSTR(x)   FAULT_STR(x)
+
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0 && !FAULT_HANDLER_FULL_CONTEXT
+#error FAULT_HANDLER_FAULT_STACK_SIZE needs FAULT_HANDLER_FULL_CONTEXT
+#endif
+#if (FAULT_HANDLER_FAULT_STACK_SIZE % 8) != 0
+#error FAULT_HANDLER_FAULT_STACK_SIZE must be a multiple of 8
+#endif
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 65535
+#error FAULT_HANDLER_FAULT_STACK_SIZE must fit a MOVW immediate
+#endif
+
+#if (FAULT_HANDLER_STACK_SNAPSHOT % 4) != 0
+#error FAULT_HANDLER_STACK_SNAPSHOT must be a multiple of 4
+#endif
+
+#if FAULT_HANDLER_HOOKS > 32
+#error FAULT_HANDLER_HOOKS must be at most 32
+#endif
+
+#if !FAULT_ARCH_CFSR && FAULT_HANDLER_SEPARATE_HANDLERS
+#error ARMv6-M and ARMv8-M Baseline have no configurable fault exceptions
+#endif
+#if !FAULT_ARCH_CFSR && FAULT_HANDLER_BENCH
+#error FAULT_HANDLER_BENCH needs the DWT cycle counter of ARMv7-M or ARMv8-M Mainline
+#endif
+#if !FAULT_ARCH_CFSR && FAULT_HANDLER_FAULT_STACK_SIZE > 0 && defined(__ICCARM__)
+#error FAULT_HANDLER_FAULT_STACK_SIZE needs MOVW/MOVT with IAR, not in ARMv6-M
+#endif
+#if FAULT_HANDLER_CORE && FAULT_HANDLER_CAPTURE_ONLY
+#error FAULT_HANDLER_CORE needs an output sink
+#endif
+
+#define FAULT_STACK_PAINT   0xFA57FA57UL  /**< Fill pattern of the unused fault stack */
+
+/* Frame patching is shared by the recovery policy and the probes */
+#define FAULT_RESUME        (FAULT_HANDLER_RECOVERY || FAULT_HANDLER_PROBE)
+
+/* The cycle counter is shared by the output budget and the hook budgets */
+#define FAULT_CYCLES        ((FAULT_HANDLER_OUTPUT_BUDGET > 0 && !FAULT_HANDLER_CAPTURE_ONLY) || \
+                             FAULT_HANDLER_HOOKS > 0)
+
+#if defined(__CC_ARM) || defined(__ICCARM__) || defined(__GNUC__)
+#define DSB()           __asm volatile("DSB")
+#else
+#define DSB()
+#endif
 /** 
   memory mapped structure for System Control Block (SCB)
   @{
@@ -45,12 +114,27 @@ typedef struct {
 #define SCB_BASE            (SCS_BASE +  0x0D00)    /**< System Control Block Base Address */
 #define SCB                 ((SCB_Type *) SCB_BASE) /**< SCB configuration struct          */
 
+#define SCB_AIRCR_VECTKEY         ((uint32_t)0x05FA0000) /**< Write key of AIRCR */
+#define SCB_AIRCR_PRIGROUP        ((uint32_t)0x00000700) /**< Priority grouping, kept on reset request */
+#define SCB_AIRCR_SYSRESETREQ     ((uint32_t)0x00000004) /**< System reset request */
+
+#define SCB_HFSR_VECTTBL          ((uint32_t)0x00000002) /**< Vector table read fault */
+#define SCB_HFSR_FORCED           ((uint32_t)0x40000000) /**< Escalated configurable fault */
+#define SCB_HFSR_DEBUGEVT         ((uint32_t)0x80000000) /**< Debug event */
+
+#define SCB_ICSR_VECTACTIVE       ((uint32_t)0x000001FF) /**< Active exception number */
+#define SCB_SHCSR_MEMFAULTENA     ((uint32_t)0x00010000) /**< MemManage exception enable */
+#define SCB_SHCSR_BUSFAULTENA     ((uint32_t)0x00020000) /**< BusFault exception enable */
+#define SCB_SHCSR_USGFAULTENA     ((uint32_t)0x00040000) /**< UsageFault exception enable */
+#define SCB_SHCSR_SECUREFAULTENA  ((uint32_t)0x00080000) /**< SecureFault exception enable, Secure only */
+
 /* Bit definition for SCB_CFSR register */
 /**< MFSR */
 #define  SCB_CFSR_IACCVIOL     ((uint32_t)0x00000001) /**< Instruction access violation */
 #define  SCB_CFSR_DACCVIOL     ((uint32_t)0x00000002) /**< Data access violation */
 #define  SCB_CFSR_MUNSTKERR    ((uint32_t)0x00000008) /**< Unstacking error */
 #define  SCB_CFSR_MSTKERR      ((uint32_t)0x00000010) /**< Stacking error */
+#define  SCB_CFSR_MLSPERR      ((uint32_t)0x00000020) /**< Floating-point lazy state preservation error */
 #define  SCB_CFSR_MMARVALID    ((uint32_t)0x00000080) /**< Memory Manage Address Register address valid flag */
 /**< BFSR */
 #define  SCB_CFSR_IBUSERR      ((uint32_t)0x00000100) /**< Instruction bus error flag */
@@ -58,6 +142,7 @@ typedef struct {
 #define  SCB_CFSR_IMPRECISERR  ((uint32_t)0x00000400) /**< Imprecise data bus error */
 #define  SCB_CFSR_UNSTKERR     ((uint32_t)0x00000800) /**< Unstacking error */
 #define  SCB_CFSR_STKERR       ((uint32_t)0x00001000) /**< Stacking error */
+#define  SCB_CFSR_LSPERR       ((uint32_t)0x00002000) /**< Floating-point lazy state preservation error */
 #define  SCB_CFSR_BFARVALID    ((uint32_t)0x00008000) /**< Bus Fault Address Register address valid flag */
 /**< UFSR */
 #define  SCB_CFSR_UNDEFINSTR   ((uint32_t)0x00010000) /**< The processor attempt to excecute an undefined instruction */
@@ -67,236 +152,1879 @@ typedef struct {
 #define  SCB_CFSR_UNALIGNED    ((uint32_t)0x01000000) /**< Fault occurs when there is an attempt to make an unaligned memory access */
 #define  SCB_CFSR_DIVBYZERO    ((uint32_t)0x02000000) /**< Fault occurs when SDIV or DIV instruction is used with a divisor of 0 */
 
+#define DEMCR               (*((volatile uint32_t *)0xE000EDFCUL)) /**< Debug Exception and Monitor Control Register */
+#define DEMCR_TRCENA        ((uint32_t)0x01000000)                 /**< DWT and ITM enable */
+#define DWT_CTRL            (*((volatile uint32_t *)0xE0001000UL)) /**< DWT Control Register */
+#define DWT_CYCCNT          (*((volatile uint32_t *)0xE0001004UL)) /**< DWT cycle counter */
+#define DWT_CTRL_CYCCNTENA  ((uint32_t)0x00000001)                 /**< Cycle counter enable */
+#define DWT_CTRL_NOCYCCNT   ((uint32_t)0x02000000)                 /**< No cycle counter implemented */
+
+#if FAULT_HANDLER_BENCH
+#define BENCH_STAMP(point)  (fault_bench.point = DWT_CYCCNT)
+#else
+#define BENCH_STAMP(point)
+#endif
+
+#define FPCCR               (*((volatile uint32_t *)0xE000EF34UL)) /**< Floating-point Context Control Register */
+#define FPCCR_LSPACT        ((uint32_t)0x00000001)                 /**< Lazy state preservation is pending   */
+
+#define EXC_RETURN_STD_FRAME ((uint32_t)0x00000010) /**< EXC_RETURN bit 4: basic frame, no FP state */
+#define EXC_RETURN_PSP       ((uint32_t)0x00000004) /**< EXC_RETURN bit 2: frame on the process stack */
+
+#define XPSR_T               ((uint32_t)0x01000000) /**< Thumb state */
+#define XPSR_IT              ((uint32_t)0x0600FC00) /**< IT[1:0] in bits 26:25, IT[7:2] in bits 15:10 */
+
+/* Causes that leave no usable frame to return through */
+#define FAULT_NO_RESUME     (SCB_CFSR_MUNSTKERR | SCB_CFSR_MSTKERR | SCB_CFSR_MLSPERR | \
+                             SCB_CFSR_UNSTKERR | SCB_CFSR_STKERR | SCB_CFSR_LSPERR)
+/* Instruction-side causes: the stacked pc is not an instruction to step over */
+#define FAULT_NO_SKIP       (SCB_CFSR_IACCVIOL | SCB_CFSR_IBUSERR | SCB_CFSR_INVSTATE | SCB_CFSR_INVPC)
+
+enum { r0, r1, r2, r3, r12, lr, pc, psr};
+
+/* Extended frame: s0-s15, FPSCR and a reserved word follow the basic frame */
+enum { s0 = psr + 1, fpscr = s0 + 16, fp_reserved, fp_frame_end };
+
+/*
+ * Public data
+ */
+FAULT_NOINIT fault_ring_t fault_ring;
+
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0
+/** Dedicated fault stack, the trampoline loads MSP with its end address */
+FAULT_USED uint64_t fault_stack[FAULT_HANDLER_FAULT_STACK_SIZE / 8];
+#endif
+
+#if FAULT_HANDLER_STATS
+static FAULT_NOINIT fault_stats_t faultStats;
+#endif
+
+#if FAULT_HANDLER_COMPACT && !FAULT_HANDLER_TEXT && !FAULT_HANDLER_CAPTURE_ONLY
+static uint8_t compactBuf[FAULT_CODEC_MAX_SIZE];
+#endif
+
+/**
+ * \brief Boot counter and the boot and uptime of the latest faults
+ */
+typedef struct {
+	uint32_t magic;                                     /**< #FAULT_BOOT_MAGIC             */
+	uint32_t boot;                                      /**< Current boot number           */
+#if FAULT_HANDLER_LOOP_FAULTS > 0
+	uint32_t head;                                      /**< Next history entry            */
+	uint32_t count;                                     /**< Valid history entries         */
+	uint32_t fault_boot[FAULT_HANDLER_LOOP_FAULTS];     /**< Boot number of each fault     */
+	uint32_t fault_uptime[FAULT_HANDLER_LOOP_FAULTS];   /**< Uptime in ms of each fault    */
+#endif
+} boot_history_t;
+
+static FAULT_NOINIT boot_history_t bootHistory;
+static uint32_t (*faultUptime)(void);
+static bool safeMode;
+
+#if FAULT_HANDLER_BENCH
+/** entry is stored by the trampoline, at offset 0 */
+FAULT_USED volatile fault_bench_t fault_bench;
+#endif
+
+#if !FAULT_HANDLER_CAPTURE_ONLY
+static const fault_sink_t *faultSink = &FAULT_HANDLER_DEFAULT_SINK;
+#endif
+
+#if FAULT_HANDLER_OUTPUT_BUDGET > 0 && !FAULT_HANDLER_CAPTURE_ONLY
+static uint32_t budgetStart;              /**< CYCCNT when the output started  */
+static uint32_t budgetExpired;            /**< Output budget used up           */
+#endif
+
+#if FAULT_HANDLER_CORE
+static fault_core_cursor_t faultCore;     /**< Core file sent after the record */
+#endif
+
+#if FAULT_HANDLER_RECOVERY
+static uint8_t faultPolicy[32];           /**< fault_action_t per CFSR bit     */
+static fault_landing_t faultLanding[32];  /**< Landing per CFSR bit, REDIRECT  */
+#endif
+
+#if FAULT_HANDLER_HOOKS > 0
+typedef struct {
+	fault_hook_t hook;
+	uint32_t priority;
+	uint32_t budget;                      /**< Cycles, 0 for no limit          */
+} hook_entry_t;
+
+static hook_entry_t faultHooks[FAULT_HANDLER_HOOKS];  /**< Run order, lowest priority first */
+static uint32_t hookCount;
+static uint32_t hookStart;                /**< CYCCNT when the running hook started */
+static uint32_t hookBudget;               /**< Cycles of the running hook, 0 if none */
+#endif
+
+#if FAULT_HANDLER_RTOS
+static const fault_rtos_t *faultRtos;
+
+/** Task table built by TaskCapture() before it is copied into the record */
+static struct {
+	fault_task_record_t task;
+	fault_task_record_t tasks[FAULT_HANDLER_RTOS_TASKS];
+} taskStage;
+#endif
+
+#if FAULT_HANDLER_PROBE
+static volatile uint32_t probeArmed;     /**< A probe access is in progress     */
+static volatile uint32_t probeFaulted;   /**< The armed probe access faulted    */
+static volatile uintptr_t probeAddr;     /**< Address of the armed probe access */
+#endif
 
 /*
  * Private Functions
  */
-static void printErrorMsg(const char * errMsg);
-static void printUsageErrorMsg(uint32_t CFSRValue);
-static void printBusFaultErrorMsg(uint32_t CFSRValue);
-static void printMemoryManagementErrorMsg(uint32_t CFSRValue);
-static void DumpStack(uint32_t stack[]);
-static void HardFaultHandlerUser(uint32_t stack[]);
+static void FaultProcess(uint32_t stack[], uint32_t excReturn, const fault_context_t *ctx);
+#if FAULT_HANDLER_RECOVERY
+static fault_action_t FaultPolicy(const fault_record_t *rec);
+static fault_landing_t FaultLanding(uint32_t cfsr);
+#endif
+#if FAULT_RESUME
+static bool FaultResume(uint32_t stack[], uint32_t cfsr, uint32_t hfsr, fault_landing_t landing);
+static uint32_t ItAdvance(uint32_t xpsr);
+#endif
+#if FAULT_HANDLER_PROBE
+static bool ProbeFault(uint32_t stack[]);
+#endif
+static void SystemReset(void);
+static void RetainedClean(void);
+#if FAULT_CYCLES
+static bool CycleCounterStart(void);
+#endif
+#if FAULT_HANDLER_HOOKS > 0
+static void RunHooks(fault_record_t *rec);
+#endif
+#if FAULT_HANDLER_OUTPUT_BUDGET > 0 && !FAULT_HANDLER_CAPTURE_ONLY
+static const fault_sink_t *BudgetSinkStart(void);
+static uint32_t BudgetWrite(const void *buf, uint32_t len);
+static void BudgetFlush(void);
+
+static const fault_sink_t budgetSink = { BudgetWrite, BudgetFlush };
+#endif
+static fault_record_t *CaptureRecord(uint32_t stack[], uint32_t excReturn, const fault_context_t *ctx);
+static uint32_t Signature(uint32_t spc, uint32_t slr, uint32_t cfsr, uint32_t hfsr);
+static void BootHistoryReset(void);
+#if FAULT_HANDLER_LOOP_FAULTS > 0
+static void BootHistoryAdd(void);
+static bool CrashLoop(void);
+#endif
+#if FAULT_HANDLER_STATS
+static void StatsReset(void);
+static void StatsUpdate(const fault_record_t *rec);
+#endif
+#if FAULT_HANDLER_BACKTRACE_DEPTH > 0
+static const uint32_t *CallerStack(const uint32_t stack[], const fault_record_t *rec);
+static uint32_t Backtrace(const uint32_t *sp, uint32_t out[]);
+#endif
+#if FAULT_HANDLER_STACK_SNAPSHOT > 0
+static uint32_t SnapshotStack(const uint32_t *sp, uint32_t out[]);
+#endif
+#if FAULT_HANDLER_RTOS
+static void TaskCapture(fault_record_t *rec, const uint32_t stack[], uint32_t excReturn);
+static void TaskStore(fault_task_record_t *out, const fault_task_t *task);
+#endif
 
 
 /**
  * \brief The Hard Fault Handler
  *
  */
-void Hard_Fault_Handler(uint32_t stack[])
+FAULT_USED void Hard_Fault_Handler(uint32_t stack[], uint32_t excReturn)
 {
-	static char msg[80];
-	printErrorMsg("Hard Fault!!!\n");
-	sprintf(msg, "SCB->HFSR = 0x%08x\n", SCB->HFSR);
-	printErrorMsg(msg);
+	FaultProcess(stack, excReturn, 0);
+}
 
-	if ((SCB->HFSR & (1 << 30)) != 0) {
-		printErrorMsg("Forced Hard Fault\n");
-		sprintf(msg, "SCB->CFSR = 0x%08x\n", SCB->CFSR);
-		printErrorMsg(msg);
+/**
+ * \brief The Hard Fault Handler, entered with the full register context
+ */
+FAULT_USED void Hard_Fault_Context_Handler(fault_context_t *ctx)
+{
+	FaultProcess(ctx->frame, ctx->exc_return, ctx);
+}
 
-		if ((SCB->CFSR & 0xFFFF0000) != 0) {
-			printUsageErrorMsg(SCB->CFSR);
-		}
+/**
+ * \brief Record, run the hooks, print, then stop, reset or return as the
+ * policy says
+ *
+ * Returning from here returns from the exception through the frame, which
+ * FaultResume() has patched.
+ *
+ * \param stack hardware-stacked frame
+ * \param excReturn lr on exception entry
+ * \param ctx registers pushed by the trampoline, or 0
+ */
+static void FaultProcess(uint32_t stack[], uint32_t excReturn, const fault_context_t *ctx)
+{
+	uint32_t *frame = fault_arch_frame(stack, excReturn);
+	fault_record_t *rec;
+	fault_action_t action;
+#if !FAULT_HANDLER_CAPTURE_ONLY
+	const fault_sink_t *sink = faultSink;
+#endif
 
-		if ((SCB->CFSR & 0xFF00) != 0) {
-			printBusFaultErrorMsg(SCB->CFSR);
-		}
+#if FAULT_HANDLER_PROBE
+	/* an expected probe fault is neither recorded nor printed */
+	if (probeArmed && frame != 0 && ProbeFault(frame)) {
+		return;
+	}
+#endif
 
-		if ((SCB->CFSR & 0xFF) != 0) {
-			printMemoryManagementErrorMsg(SCB->CFSR);
-		}
+	rec = CaptureRecord(frame, excReturn, ctx);
+	BENCH_STAMP(record);
+#if FAULT_HANDLER_HOOKS > 0
+	/* safety actions first, before anything slow or that may fault again */
+	RunHooks(rec);
+#endif
+#if FAULT_HANDLER_RTOS
+	TaskCapture(rec, stack, excReturn);
+#endif
+#if FAULT_HANDLER_STATS
+	StatsUpdate(rec);
+#endif
+
+#if FAULT_HANDLER_RECOVERY
+	action = FaultPolicy(rec);
+#else
+	action = FAULT_ACTION_HALT;
+#endif
+#if FAULT_HANDLER_RESET_ON_FAULT
+	if (action == FAULT_ACTION_HALT) {
+		action = FAULT_ACTION_RESET;
+	}
+#endif
+	if (rec->action != action) {
+		rec->action = action;
+#if FAULT_HANDLER_CRC
+		rec->crc = fault_record_crc(rec);
+#endif
+	}
+#if FAULT_HANDLER_LOOP_FAULTS > 0
+	/* a fault the policy recovers from does not end the boot */
+	if (action == FAULT_ACTION_RESET || action == FAULT_ACTION_HALT) {
+		BootHistoryAdd();
 	}
+#endif
+
+#if FAULT_HANDLER_FLASH
+	/* a repeat only bumped the count of a record already persisted */
+	if (rec->count == 1) {
+		fault_flash_store(rec);
+	}
+#endif
+	RetainedClean();
+
+#if FAULT_HANDLER_OUTPUT_BUDGET > 0 && !FAULT_HANDLER_CAPTURE_ONLY
+	/* the record is already retained: output must not delay the reset */
+	if (rec->action == FAULT_ACTION_RESET) {
+		sink = BudgetSinkStart();
+	}
+#endif
+
+#if FAULT_HANDLER_TEXT
+	fault_print_record(rec, sink);
+	sink->flush();
+#elif FAULT_HANDLER_COMPACT && !FAULT_HANDLER_CAPTURE_ONLY
+	fault_write(sink, compactBuf, fault_record_encode(rec, compactBuf, sizeof(compactBuf)));
+	sink->flush();
+#elif !FAULT_HANDLER_CAPTURE_ONLY
+	fault_write(sink, rec, sizeof(*rec));
+	sink->flush();
+#else
+	(void)rec;
+#endif
+#if FAULT_HANDLER_CORE
+	fault_core_begin(&faultCore, rec);
+	(void)fault_core_write(&faultCore, sink);
+	sink->flush();
+#endif
+	BENCH_STAMP(output);
 
-	DumpStack(stack);
-	HardFaultHandlerUser(stack);
+#if FAULT_HANDLER_RECOVERY
+	if (rec->action == FAULT_ACTION_SKIP && FaultResume(frame, rec->cfsr, rec->hfsr, 0)) {
+		return;
+	}
+	if (rec->action == FAULT_ACTION_REDIRECT && FaultLanding(rec->cfsr) != 0 &&
+	    FaultResume(frame, rec->cfsr, rec->hfsr, FaultLanding(rec->cfsr))) {
+		return;
+	}
+#if FAULT_HANDLER_LOOP_FAULTS > 0
+	/* the resume was refused: this boot ends here after all */
+	if (rec->action == FAULT_ACTION_SKIP || rec->action == FAULT_ACTION_REDIRECT) {
+		BootHistoryAdd();
+		fault_arch_clean(&bootHistory, sizeof(bootHistory));
+	}
+#endif
+#endif
+	/* a resume refused late still resets rather than halts in production */
+	if (rec->action == FAULT_ACTION_RESET || FAULT_HANDLER_RESET_ON_FAULT) {
+		SystemReset();
+	}
 
 #if defined(__ICCARM__)
 	__asm volatile("BKPT #01");
 #endif
 
-	while (1) {};
+	while (1) {
+#if FAULT_HANDLER_CORE
+		/* the part a stalled sink did not take goes out once it drains */
+		(void)fault_core_write(&faultCore, sink);
+#endif
+	};
 }
 
 /**
- * \brief Fill-in this function with your code to handle the exception
+ * \brief Store the binary crash record in the next retained ring slot
+ *
+ * Plain word stores only, so it is safe to call before any output and costs
+ * a few dozen cycles. The slot magic is written last: a record interrupted
+ * by a reset is never seen as valid, and the CRC catches one overwritten
+ * by a nested fault. A repeat of an undrained record only
+ * updates its count and last_seq.
  *
- * It is called after debug string prints
+ * \param stack basic frame, 0 if fault_arch_frame() cannot read it
  */
-static void HardFaultHandlerUser(uint32_t stack[])
+static fault_record_t *CaptureRecord(uint32_t stack[], uint32_t excReturn, const fault_context_t *ctx)
 {
-	/* Application specific code */
+	fault_record_t *rec;
+	uint32_t cfsr = fault_arch_cfsr();
+	uint32_t hfsr = fault_arch_hfsr();
+	/* After a stacking error the frame may point outside RAM: reading it
+	 * would fault again inside the handler and lock the core up */
+	bool framed = stack != 0 && (cfsr & (SCB_CFSR_STKERR | SCB_CFSR_MSTKERR)) == 0;
+	uint32_t spc = 0, slr = 0, sig;
+
+	if (fault_ring.magic != FAULT_RING_MAGIC || fault_ring.head >= FAULT_HANDLER_RING_SIZE) {
+		fault_ring.seq = 0;
+		fault_ring.head = 0;
+		fault_ring.magic = FAULT_RING_MAGIC;
+	}
+
+	if (framed) {
+		spc = stack[pc];
+		slr = stack[lr];
+	}
+	sig = Signature(spc, slr, cfsr, hfsr);
+
+#if FAULT_HANDLER_DEDUP
+	{
+		uint32_t i;
+
+		for (i = 0; i < FAULT_HANDLER_RING_SIZE; i++) {
+			rec = &fault_ring.slot[i];
+			if (rec->magic == FAULT_RECORD_MAGIC && rec->signature == sig &&
+			    rec->pc == spc && rec->lr == slr && rec->cfsr == cfsr && rec->hfsr == hfsr) {
+				rec->magic = 0;
+				rec->count++;
+				rec->last_seq = fault_ring.seq++;
+#if FAULT_HANDLER_CRC
+				rec->crc = fault_record_crc(rec);
+#endif
+				rec->magic = FAULT_RECORD_MAGIC;
+				return rec;
+			}
+		}
+	}
+#endif
+
+	rec = &fault_ring.slot[fault_ring.head];
+	if (++fault_ring.head >= FAULT_HANDLER_RING_SIZE) {
+		fault_ring.head = 0;
+	}
+
+	rec->magic = 0;
+	rec->seq   = fault_ring.seq++;
+	rec->action = FAULT_ACTION_HALT;
+	rec->signature = sig;
+	rec->count = 1;
+	rec->last_seq = rec->seq;
+	rec->boot = (bootHistory.magic == FAULT_BOOT_MAGIC) ? bootHistory.boot : 0;
+	rec->uptime = (faultUptime != 0) ? faultUptime() : 0;
+#if FAULT_HANDLER_HOOKS > 0
+	rec->hook_overrun = 0;
+#endif
+	rec->hfsr  = hfsr;
+	rec->cfsr  = cfsr;
+	rec->exception = SCB->ICSR & SCB_ICSR_VECTACTIVE;
+	rec->exc_return = excReturn;
+	rec->flags = ((excReturn & EXC_RETURN_STD_FRAME) == 0) ? FAULT_FLAG_FP_FRAME : 0;
+	fault_arch_status(rec);
+
+	if (framed) {
+		rec->r0    = stack[r0];
+		rec->r1    = stack[r1];
+		rec->r2    = stack[r2];
+		rec->r3    = stack[r3];
+		rec->r12   = stack[r12];
+		rec->lr    = slr;
+		rec->pc    = spc;
+		rec->psr   = stack[psr];
+	} else {
+		rec->flags |= FAULT_FLAG_NO_FRAME;
+		rec->r0    = 0;
+		rec->r1    = 0;
+		rec->r2    = 0;
+		rec->r3    = 0;
+		rec->r12   = 0;
+		rec->lr    = 0;
+		rec->pc    = 0;
+		rec->psr   = 0;
+	}
+
+	if (ctx != 0) {
+		rec->flags     |= FAULT_FLAG_CONTEXT;
+		rec->r4         = ctx->r4;
+		rec->r5         = ctx->r5;
+		rec->r6         = ctx->r6;
+		rec->r7         = ctx->r7;
+		rec->r8         = ctx->r8;
+		rec->r9         = ctx->r9;
+		rec->r10        = ctx->r10;
+		rec->r11        = ctx->r11;
+		rec->msp        = ctx->msp;
+		rec->psp        = ctx->psp;
+	}
+
+#if FAULT_HANDLER_FPU
+	/* With lazy stacking pending the frame only has room reserved for s0-s15:
+	 * the values are still in the FPU and reading them would trigger the lazy
+	 * save, so they are recorded only when already in memory */
+	if ((rec->flags & (FAULT_FLAG_FP_FRAME | FAULT_FLAG_NO_FRAME)) == FAULT_FLAG_FP_FRAME &&
+	    (FPCCR & FPCCR_LSPACT) == 0) {
+		uint32_t i;
+
+		for (i = 0; i < 16; i++) {
+			rec->s[i] = stack[s0 + i];
+		}
+		rec->fpscr = stack[fpscr];
+		rec->flags |= FAULT_FLAG_FP_REGS;
+	}
+#endif
+
+#if FAULT_HANDLER_BACKTRACE_DEPTH > 0
+	if ((rec->flags & FAULT_FLAG_NO_FRAME) == 0) {
+		rec->backtrace_count = Backtrace(CallerStack(stack, rec), rec->backtrace);
+	} else {
+		rec->backtrace_count = 0;
+	}
+#endif
+
+#if FAULT_HANDLER_STACK_SNAPSHOT > 0
+	rec->snapshot_addr = (uint32_t)(uintptr_t)stack;
+	rec->snapshot_count = (stack != 0) ? SnapshotStack(stack, rec->snapshot) : 0;
+#endif
+
+#if FAULT_HANDLER_RTOS
+	rec->task_count = 0;
+#endif
+#if FAULT_HANDLER_CRC
+	rec->crc = fault_record_crc(rec);
+#endif
+	rec->magic = FAULT_RECORD_MAGIC;
+
+	return rec;
 }
 
 /**
- * \brief Print Messages using semihosting
+ * \brief Crash signature: pc, lr, CFSR and HFSR mixed with two multiplies
  */
-static void printErrorMsg(const char * errMsg)
+static uint32_t Signature(uint32_t spc, uint32_t slr, uint32_t cfsr, uint32_t hfsr)
+{
+	uint32_t h = (spc ^ (slr * 0x9E3779B1UL)) * 0x85EBCA6BUL;
+
+	return h ^ (h >> 15) ^ cfsr ^ (hfsr >> 16) ^ (hfsr << 16);
+}
+
+#if FAULT_HANDLER_STATS
+static void StatsReset(void)
 {
-	printf("%s", errMsg);
+	uint32_t i;
+
+	faultStats.total = 0;
+	for (i = 0; i < 32; i++) {
+		faultStats.cfsr[i] = 0;
+	}
+	for (i = 0; i < FAULT_STATS_HFSR_COUNT; i++) {
+		faultStats.hfsr[i] = 0;
+	}
+	for (i = 0; i < FAULT_HANDLER_STATS_TOP; i++) {
+		faultStats.top[i].pc = 0;
+		faultStats.top[i].count = 0;
+	}
+	faultStats.magic = FAULT_STATS_MAGIC;
 }
 
 /**
- * \brief Print Usage Errors
+ * \brief Count a recorded fault
+ *
+ * One increment per set cause, and a space-saving update of the top pc
+ * table: a known pc is incremented, otherwise the least frequent entry is
+ * taken over with its count plus one.
  */
-static void printUsageErrorMsg(uint32_t CFSRValue)
+static void StatsUpdate(const fault_record_t *rec)
 {
-	printErrorMsg("Usage fault: ");
+	uint32_t bits = rec->cfsr;
+	uint32_t i, least = 0;
 
-	if ((CFSRValue & SCB_CFSR_DIVBYZERO) != 0) {
-		printErrorMsg("Divide by zero\n");
+	if (faultStats.magic != FAULT_STATS_MAGIC) {
+		StatsReset();
 	}
 
-	if ((CFSRValue & SCB_CFSR_INVSTATE) != 0) {
-		printErrorMsg("Invalid combination of EPSR and instruction,\nsuch as calling a null pointer function\n");
+	faultStats.total++;
+	while (bits != 0) {
+		faultStats.cfsr[fault_ctz(bits)]++;
+		bits &= bits - 1;
 	}
-
-	if ((CFSRValue & SCB_CFSR_UNDEFINSTR) != 0) {
-		printErrorMsg("The processor attempted to excecute an undefined instruction\n");
+	if ((rec->hfsr & SCB_HFSR_VECTTBL) != 0) {
+		faultStats.hfsr[FAULT_STATS_VECTTBL]++;
+	}
+	if ((rec->hfsr & SCB_HFSR_FORCED) != 0) {
+		faultStats.hfsr[FAULT_STATS_FORCED]++;
+	}
+	if ((rec->hfsr & SCB_HFSR_DEBUGEVT) != 0) {
+		faultStats.hfsr[FAULT_STATS_DEBUGEVT]++;
 	}
 
-	if ((CFSRValue & SCB_CFSR_INVPC) != 0) {
-		printErrorMsg("Attempt to load EXC_RETURN into pc illegally\n");
+	for (i = 0; i < FAULT_HANDLER_STATS_TOP; i++) {
+		if (faultStats.top[i].count != 0 && faultStats.top[i].pc == rec->pc) {
+			faultStats.top[i].count++;
+			return;
+		}
+		if (faultStats.top[i].count < faultStats.top[least].count) {
+			least = i;
+		}
 	}
+	faultStats.top[least].pc = rec->pc;
+	faultStats.top[least].count++;
+}
 
-	if ((CFSRValue & SCB_CFSR_NOCP) != 0) {
-		printErrorMsg("Attempt to use a coprocessor instruction\n");
+/**
+ * \brief Copy the retained fault counters
+ *
+ * No allocation, safe to poll from a telemetry task.
+ *
+ * \param out where to copy the counters, all zero if none are retained
+ */
+void fault_stats_get(fault_stats_t *out)
+{
+	if (faultStats.magic != FAULT_STATS_MAGIC) {
+		StatsReset();
 	}
+	*out = faultStats;
+}
+
+/**
+ * \brief Zero the counters, e.g. once they have been sent
+ */
+void fault_stats_clear(void)
+{
+	StatsReset();
+}
+#endif
+
+#if FAULT_HANDLER_BACKTRACE_DEPTH > 0
+/**
+ * \brief Stack pointer of the faulting code, just above the exception frame
+ *
+ * The frame is 8 words, or 26 with FP state; stacked xPSR bit 9 tells the
+ * core added an alignment word above it.
+ *
+ * \param stack hardware-stacked frame
+ * \param rec record with psr and flags already filled
+ */
+static const uint32_t *CallerStack(const uint32_t stack[], const fault_record_t *rec)
+{
+	const uint32_t *sp = &stack[((rec->flags & FAULT_FLAG_FP_FRAME) != 0) ? fp_frame_end : psr + 1];
 
-	if ((CFSRValue & SCB_CFSR_UNALIGNED) != 0) { /* if enabled it is for all instruction, otherwise only for some of them */
-		printErrorMsg("Attempt to make an unaligned memory access\n");
+	if ((rec->psr & (1UL << 9)) != 0) {
+		sp++;
 	}
+	return sp;
 }
 
 /**
- * \brief Print Bus Fault Errors
+ * \brief Heuristic backtrace: scan the stack for Thumb return addresses
+ *
+ * A word is kept when it is odd, inside the code region, and the instruction
+ * before it is a BL or a BLX register. At most #FAULT_HANDLER_BACKTRACE_SCAN
+ * words are read, all inside the RAM region, so the cost is bounded and no
+ * nested BusFault is possible.
+ *
+ * \param sp first stack word above the exception frame
+ * \param out where to store up to #FAULT_HANDLER_BACKTRACE_DEPTH addresses
+ * \return number of addresses stored
  */
-static void printBusFaultErrorMsg(uint32_t CFSRValue)
+static uint32_t Backtrace(const uint32_t *sp, uint32_t out[])
 {
-	char str[200];
-	printErrorMsg("Bus fault: ");
-	CFSRValue = (CFSRValue & 0x0000FF00);
-	sprintf(str, "%.2X\n", CFSRValue);
-	printErrorMsg(str);
+	uintptr_t addr = (uintptr_t)sp;
+	uintptr_t end;
+	uint32_t found = 0;
 
-	if ((CFSRValue & SCB_CFSR_IBUSERR) != 0) {
-		printErrorMsg("Instruction bus error\n");
+	if ((addr & 3) != 0 || addr < FAULT_HANDLER_RAM_START || addr >= FAULT_HANDLER_RAM_END) {
+		return 0;
 	}
 
-	if ((CFSRValue & SCB_CFSR_PRECISERR) != 0) {
-		printErrorMsg("Precise data bus error\n");
+	end = FAULT_HANDLER_RAM_END;
+	if ((end - addr) / 4 > FAULT_HANDLER_BACKTRACE_SCAN) {
+		end = addr + FAULT_HANDLER_BACKTRACE_SCAN * 4;
 	}
 
-	if ((CFSRValue & SCB_CFSR_IMPRECISERR) != 0) {
-		printErrorMsg("Imprecise data bus error\n");
+	for (; addr < end && found < FAULT_HANDLER_BACKTRACE_DEPTH; addr += 4) {
+		uint32_t word = *(const uint32_t *)addr;
+		uintptr_t ret = word & ~1UL;
+		const uint16_t *insn;
+
+		if ((word & 1) == 0 || ret < FAULT_HANDLER_CODE_START + 4 || ret >= FAULT_HANDLER_CODE_END) {
+			continue;
+		}
+
+		insn = (const uint16_t *)(ret - 4);
+		if (((insn[0] & 0xF800) == 0xF000 && (insn[1] & 0xD000) == 0xD000) || /* BL <label> */
+		    (insn[1] & 0xFF87) == 0x4780) {                                 /* BLX <Rm>   */
+			out[found++] = word;
+		}
 	}
 
-	if ((CFSRValue & SCB_CFSR_UNSTKERR) != 0) {
-		printErrorMsg("Unstacking error\n");
+	return found;
+}
+#endif
+
+#if FAULT_HANDLER_STACK_SNAPSHOT > 0
+/**
+ * \brief Copy the top of the faulting stack
+ *
+ * The copy is clamped to the RAM region, so a bad SP cannot trigger a nested
+ * BusFault, and moves four words per iteration so the compiler emits LDM/STM
+ * pairs.
+ *
+ * \param sp start of the copy, the hardware-stacked frame
+ * \param out where to store up to #FAULT_HANDLER_STACK_SNAPSHOT words
+ * \return number of words copied
+ */
+static uint32_t SnapshotStack(const uint32_t *sp, uint32_t out[])
+{
+	uintptr_t addr = (uintptr_t)sp;
+	uint32_t n = FAULT_HANDLER_STACK_SNAPSHOT;
+	uint32_t i;
+
+	if ((addr & 3) != 0 || addr < FAULT_HANDLER_RAM_START || addr >= FAULT_HANDLER_RAM_END) {
+		return 0;
 	}
 
-	if ((CFSRValue & SCB_CFSR_STKERR) != 0) {
-		printErrorMsg("Stacking error\n");
+	if ((FAULT_HANDLER_RAM_END - addr) / 4 < n) {
+		n = (FAULT_HANDLER_RAM_END - addr) / 4;
 	}
 
-	if ((CFSRValue & SCB_CFSR_BFARVALID) != 0) {
-		sprintf(str, "Bus Fault Address Register address valid flag\nBFAR value = 0x%.8X\n", SCB->BFAR);
-		printErrorMsg(str);
+	for (i = 0; i + 4 <= n; i += 4) {
+		uint32_t a = sp[i], b = sp[i + 1], c = sp[i + 2], d = sp[i + 3];
+		out[i] = a;
+		out[i + 1] = b;
+		out[i + 2] = c;
+		out[i + 3] = d;
 	}
+	for (; i < n; i++) {
+		out[i] = sp[i];
+	}
+
+	return n;
 }
+#endif
 
+#if FAULT_HANDLER_RTOS
 /**
- * \brief Print Memory Management Errors
+ * \brief Install the RTOS adapter, e.g. &fault_rtos_freertos
+ *
+ * \param rtos adapter, 0 to stop recording tasks
  */
-static void printMemoryManagementErrorMsg(uint32_t CFSRValue)
+void fault_handler_set_rtos(const fault_rtos_t *rtos)
 {
-	char str[200];
-	printErrorMsg("Memory Management (MPU) fault: ");
-	CFSRValue &= 0x000000FF; /* mask mem faults only */
-	sprintf(str, "%.2X\n", CFSRValue);
-	printErrorMsg(str);
+	faultRtos = rtos;
+}
 
-	if ((CFSRValue & SCB_CFSR_IACCVIOL) != 0) {
-		printErrorMsg("Instruction access violation\n");
-	}
+/**
+ * \brief Record the faulting task and the stack of every task
+ *
+ * Runs once the record is committed: a stack overflow may have corrupted
+ * the kernel lists the adapter walks, so the walk fills taskStage and the
+ * sealed record is only opened to copy the finished table in. Faulting in
+ * the walk leaves the record without its task table. The running task is
+ * saved with the frame address, its saved sp being stale.
+ */
+static void TaskCapture(fault_record_t *rec, const uint32_t stack[], uint32_t excReturn)
+{
+	fault_task_t task;
+	uint32_t flags = 0;
+	uint32_t count = 0;
+	uint32_t i;
 
-	if ((CFSRValue & SCB_CFSR_DACCVIOL) != 0) {
-		printErrorMsg("Data access violation\n");
+	if (faultRtos == 0) {
+		return;
 	}
 
-	if ((CFSRValue & SCB_CFSR_MUNSTKERR) != 0) {
-		printErrorMsg("Unstacking error\n");
+	if ((excReturn & EXC_RETURN_PSP) != 0 && faultRtos->current(&task)) {
+		TaskStore(&taskStage.task, &task);
+		taskStage.task.sp = (uint32_t)(uintptr_t)stack;
+		flags = FAULT_FLAG_TASK;
 	}
 
-	if ((CFSRValue & SCB_CFSR_MSTKERR) != 0) {
-		printErrorMsg("Stacking error\n");
+	for (; count < FAULT_HANDLER_RTOS_TASKS && faultRtos->task(count, &task); count++) {
+		TaskStore(&taskStage.tasks[count], &task);
+		if (flags != 0 && taskStage.tasks[count].base == taskStage.task.base) {
+			taskStage.tasks[count].sp = taskStage.task.sp;
+		}
 	}
 
-	if ((CFSRValue & SCB_CFSR_MMARVALID) != 0) {
-		sprintf(str,"Memory Manage Address Register address valid flag\nMMFAR value = 0x%.8X\n", SCB->MMFAR);
-		printErrorMsg(str);
+	rec->magic = 0;
+	rec->flags = (rec->flags & ~FAULT_FLAG_TASK) | flags;
+	rec->task = taskStage.task;
+	for (i = 0; i < count; i++) {
+		rec->tasks[i] = taskStage.tasks[i];
 	}
+	rec->task_count = count;
+#if FAULT_HANDLER_CRC
+	rec->crc = fault_record_crc(rec);
+#endif
+	rec->magic = FAULT_RECORD_MAGIC;
 }
 
-#if defined(__CC_ARM)
-__asm void HardFault_Handler(void)
-{
-	TST lr, #4
-	ITE EQ
-	MRSEQ r0, MSP
-	MRSNE r0, PSP
-	B __cpp(Hard_Fault_Handler)
-}
-#elif defined(__ICCARM__)
-void HardFault_Handler(void)
+static void TaskStore(fault_task_record_t *out, const fault_task_t *task)
 {
-	__asm("TST lr, #4");
-	__asm("ITE EQ");
-	__asm("MRSEQ r0, MSP");
-	__asm("MRSNE r0, PSP");
-	__asm("B Hard_Fault_Handler");
+	uint32_t i = 0;
+
+	out->id = task->id;
+	out->sp = (uint32_t)task->sp;
+	out->base = (uint32_t)task->base;
+	out->unused = task->unused;
+	if (task->name != 0) {
+		for (; i < FAULT_TASK_NAME_SIZE && task->name[i] != '\0'; i++) {
+			out->name[i] = task->name[i];
+		}
+	}
+	for (; i < FAULT_TASK_NAME_SIZE; i++) {
+		out->name[i] = '\0';
+	}
 }
-#else
-#warning Not supported compiler type
 #endif
 
-enum { r0, r1, r2, r3, r12, lr, pc, psr};
-
+#if FAULT_HANDLER_RECOVERY
 /**
- * \brief Dump Stack, printing all registers ARM core pushes on stack on hard fault exception
- */
-static void DumpStack(uint32_t stack[])
-{
-	static char msg[80];
-	int code_address_error=0;
-	sprintf(msg, "\nr0  = 0x%08x\n", stack[r0]);
-	printErrorMsg(msg);
-	sprintf(msg, "r1  = 0x%08x\n", stack[r1]);
-	printErrorMsg(msg);
-	sprintf(msg, "r2  = 0x%08x\n", stack[r2]);
-	printErrorMsg(msg);
-	sprintf(msg, "r3  = 0x%08x\n", stack[r3]);
-	printErrorMsg(msg);
-	sprintf(msg, "r12 = 0x%08x\n", stack[r12]);
-	printErrorMsg(msg);
-	sprintf(msg, "lr  = 0x%08x\n", stack[lr]);
-	printErrorMsg(msg);
-	sprintf(msg, "pc  = 0x%08x\n", stack[pc]);
-	printErrorMsg(msg);
-	sprintf(msg, "psr = 0x%08x\n", stack[psr]);
-	printErrorMsg(msg);
-
-	if (stack[pc] == 0) {
-		code_address_error = stack[lr];
-	} else {
-		code_address_error = stack[pc];
+ * \brief Action for the causes set in a record
+ *
+ * The most conservative action of the set causes wins. Resuming is only
+ * allowed for a configurable fault, taken directly or escalated, whose
+ * frame was stacked and will unstack cleanly.
+ */
+static fault_action_t FaultPolicy(const fault_record_t *rec)
+{
+	uint32_t bits = rec->cfsr & ~(SCB_CFSR_MMARVALID | SCB_CFSR_BFARVALID);
+	uint32_t action = FAULT_ACTION_SKIP;
+
+	if (bits == 0 || (rec->hfsr & (SCB_HFSR_VECTTBL | SCB_HFSR_DEBUGEVT)) != 0) {
+		return FAULT_ACTION_HALT;
 	}
 
-	sprintf(msg, "\n--\t--\t--\nHard fault occurred at address 0x%08x.\nFind high-level ", code_address_error);
-	printErrorMsg(msg);
-	sprintf(msg, "function with\nDisassembly window or Map file\n--\t--\t--\n");
-	printErrorMsg(msg);
-}
+	while (bits != 0) {
+		uint32_t bit = fault_ctz(bits);
+		if (faultPolicy[bit] < action) {
+			action = faultPolicy[bit];
+		}
+		bits &= bits - 1;
+	}
+
+	if (action >= FAULT_ACTION_REDIRECT &&
+	    ((rec->flags & FAULT_FLAG_NO_FRAME) != 0 || (rec->cfsr & FAULT_NO_RESUME) != 0 ||
+	     (rec->exception == 3 && (rec->hfsr & SCB_HFSR_FORCED) == 0))) {
+		return FAULT_ACTION_HALT;
+	}
+	if (action == FAULT_ACTION_SKIP && (rec->cfsr & FAULT_NO_SKIP) != 0) {
+		return FAULT_ACTION_HALT;
+	}
+
+	return (fault_action_t)action;
+}
+
+/**
+ * \brief Landing function of the first set cause with a REDIRECT policy
+ */
+static fault_landing_t FaultLanding(uint32_t cfsr)
+{
+	uint32_t bits = cfsr & ~(SCB_CFSR_MMARVALID | SCB_CFSR_BFARVALID);
+
+	while (bits != 0) {
+		uint32_t bit = fault_ctz(bits);
+		if (faultPolicy[bit] == FAULT_ACTION_REDIRECT && faultLanding[bit] != 0) {
+			return faultLanding[bit];
+		}
+		bits &= bits - 1;
+	}
+	return 0;
+}
+
+/**
+ * \brief Choose what happens after faults with the given causes
+ *
+ * Causes without a policy halt. SKIP is refused for instruction fetch and
+ * state faults, and any resume for stacking errors: those halt instead.
+ *
+ * \param cfsr_bits SCB_CFSR_* causes, e.g. DIVBYZERO or PRECISERR
+ * \param action what to do once the record is stored and printed
+ * \param landing resume address for #FAULT_ACTION_REDIRECT, 0 otherwise
+ */
+void fault_handler_set_policy(uint32_t cfsr_bits, fault_action_t action, fault_landing_t landing)
+{
+	while (cfsr_bits != 0) {
+		uint32_t bit = fault_ctz(cfsr_bits);
+		faultPolicy[bit] = (uint8_t)action;
+		faultLanding[bit] = landing;
+		cfsr_bits &= cfsr_bits - 1;
+	}
+}
+#endif
+
+#if FAULT_RESUME
+/**
+ * \brief Patch the frame so the exception returns past the fault
+ *
+ * Without a landing function the 16- or 32-bit Thumb instruction at the
+ * stacked pc is stepped over and ITSTATE advanced like the core would; after
+ * an imprecise BusFault the pc is already past the store, so the frame is
+ * left as is. With a landing function execution resumes there in Thumb
+ * state, outside any IT block. The sticky CFSR and HFSR bits are cleared so
+ * the next fault starts clean.
+ *
+ * \param stack hardware-stacked frame
+ * \param cfsr CFSR of the fault
+ * \param hfsr HFSR of the fault
+ * \param landing resume address, 0 to skip the faulting instruction
+ * \return false if the frame cannot be patched, the caller then halts
+ */
+static bool FaultResume(uint32_t stack[], uint32_t cfsr, uint32_t hfsr, fault_landing_t landing)
+{
+	uint32_t xpsr = stack[psr];
+
+	if (landing != 0) {
+		stack[pc] = (uint32_t)((uintptr_t)landing & ~1UL);
+		stack[psr] = (xpsr & ~XPSR_IT) | XPSR_T;
+	} else if ((cfsr & SCB_CFSR_IMPRECISERR) == 0) {
+		uintptr_t addr = stack[pc];
+		uint16_t insn;
+
+		if ((addr & 1) != 0 || addr < FAULT_HANDLER_CODE_START || addr + 4 > FAULT_HANDLER_CODE_END) {
+			return false;
+		}
+		insn = *(const uint16_t *)addr;
+		stack[pc] = (uint32_t)(addr + (((insn & 0xF800) >= 0xE800) ? 4 : 2));
+		stack[psr] = ItAdvance(xpsr);
+	}
+
+	fault_arch_clear(cfsr, hfsr);
+	return true;
+}
+
+/**
+ * \brief ITSTATE after one instruction of an IT block, ITAdvance() in the ARM ARM
+ */
+static uint32_t ItAdvance(uint32_t xpsr)
+{
+	uint32_t it = ((xpsr >> 25) & 0x03) | ((xpsr >> 8) & 0xFC);
+
+	if ((it & 0x07) == 0) {
+		it = 0;
+	} else {
+		it = (it & 0xE0) | ((it << 1) & 0x1F);
+	}
+
+	return (xpsr & ~XPSR_IT) | ((it & 0x03) << 25) | ((it & 0xFC) << 8);
+}
+#endif
+
+#if FAULT_HANDLER_PROBE
+/**
+ * \brief Consume the fault of an armed probe access
+ *
+ * Only a data access fault at the probed address, or an imprecise BusFault,
+ * is taken as the probe's own: anything else goes through the normal path.
+ * ARMv6-M reports no cause or address, any fault while armed is the probe's.
+ *
+ * \return true if the probe was disarmed and the frame patched
+ */
+static bool ProbeFault(uint32_t stack[])
+{
+	uint32_t cfsr = fault_arch_cfsr();
+	uint32_t hfsr = fault_arch_hfsr();
+	bool own;
+
+	if ((cfsr & FAULT_NO_RESUME) != 0 || (hfsr & (SCB_HFSR_VECTTBL | SCB_HFSR_DEBUGEVT)) != 0) {
+		return false;
+	}
+
+#if FAULT_ARCH_CFSR
+	own = ((cfsr & SCB_CFSR_IMPRECISERR) != 0) ||
+	      ((cfsr & (SCB_CFSR_PRECISERR | SCB_CFSR_BFARVALID)) == (SCB_CFSR_PRECISERR | SCB_CFSR_BFARVALID) &&
+	       SCB->BFAR == probeAddr) ||
+	      ((cfsr & (SCB_CFSR_DACCVIOL | SCB_CFSR_MMARVALID)) == (SCB_CFSR_DACCVIOL | SCB_CFSR_MMARVALID) &&
+	       SCB->MMFAR == probeAddr);
+#else
+	own = true;
+#endif
+
+	if (!own || !FaultResume(stack, cfsr, hfsr, 0)) {
+		return false;
+	}
+
+	probeFaulted = 1;
+	probeArmed = 0;
+	return true;
+}
+
+/**
+ * \brief Read a word that may not exist
+ *
+ * The access runs with the probe armed: a BusFault or MemManage fault on it
+ * makes the handler step over the load and return here instead of halting.
+ * Not reentrant, do not probe from an interrupt while probing in thread mode.
+ *
+ * \param addr word address to read
+ * \param out where to store the value, untouched on failure
+ * \return true if the read completed
+ */
+bool fault_probe_read32(uintptr_t addr, uint32_t *out)
+{
+	uint32_t value;
+
+	probeAddr = addr;
+	probeFaulted = 0;
+	probeArmed = 1;
+	value = *(volatile const uint32_t *)addr;
+	DSB();
+	probeArmed = 0;
+
+	if (probeFaulted) {
+		return false;
+	}
+	*out = value;
+	return true;
+}
+
+/**
+ * \brief Write a word that may not exist
+ *
+ * The DSB makes a buffered write fault, which is imprecise, before the
+ * probe is disarmed.
+ *
+ * \param addr word address to write
+ * \param value value to write
+ * \return true if the write completed
+ */
+bool fault_probe_write32(uintptr_t addr, uint32_t value)
+{
+	probeAddr = addr;
+	probeFaulted = 0;
+	probeArmed = 1;
+	*(volatile uint32_t *)addr = value;
+	DSB();
+	probeArmed = 0;
+
+	return !probeFaulted;
+}
+#endif
+
+/**
+ * \brief Write the retained state back to RAM once it is final
+ *
+ * With a write-back D-cache the record may only be in cache lines, which a
+ * reset drops and a debugger does not see.
+ */
+static void RetainedClean(void)
+{
+	fault_arch_clean(&fault_ring, sizeof(fault_ring));
+#if FAULT_HANDLER_STATS
+	fault_arch_clean(&faultStats, sizeof(faultStats));
+#endif
+	fault_arch_clean(&bootHistory, sizeof(bootHistory));
+}
+
+/**
+ * \brief Request a system reset and wait for it
+ */
+static void SystemReset(void)
+{
+	DSB();
+	SCB->AIRCR = SCB_AIRCR_VECTKEY | (SCB->AIRCR & SCB_AIRCR_PRIGROUP) | SCB_AIRCR_SYSRESETREQ;
+	DSB();
+	while (1) {};
+}
+
+#if FAULT_HANDLER_OUTPUT_BUDGET > 0 && !FAULT_HANDLER_CAPTURE_ONLY
+/**
+ * \brief Start the output budget and return the sink that enforces it
+ *
+ * The DWT cycle counter is enabled if the debugger did not already; on a
+ * part without one the output is not capped.
+ */
+static const fault_sink_t *BudgetSinkStart(void)
+{
+	if (!CycleCounterStart()) {
+		return faultSink;
+	}
+
+	budgetStart = DWT_CYCCNT;
+	budgetExpired = 0;
+	return &budgetSink;
+}
+
+/**
+ * \brief Forward to the selected sink until #FAULT_HANDLER_OUTPUT_BUDGET cycles have passed
+ */
+static uint32_t BudgetWrite(const void *buf, uint32_t len)
+{
+	if (budgetExpired || (uint32_t)(DWT_CYCCNT - budgetStart) >= FAULT_HANDLER_OUTPUT_BUDGET) {
+		budgetExpired = 1;
+		return 0;
+	}
+	return faultSink->write(buf, len);
+}
+
+static void BudgetFlush(void)
+{
+	if (!budgetExpired) {
+		faultSink->flush();
+	}
+}
+#endif
+
+#if FAULT_CYCLES
+/**
+ * \brief Enable the DWT cycle counter if the debugger did not already
+ *
+ * \return false on a part without one, budgets are then not enforced
+ */
+static bool CycleCounterStart(void)
+{
+	/* ARMv6-M has no cycle counter and no NOCYCCNT bit to tell */
+	if (!FAULT_ARCH_CFSR || (DWT_CTRL & DWT_CTRL_NOCYCCNT) != 0) {
+		return false;
+	}
+
+	DEMCR |= DEMCR_TRCENA;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	return true;
+}
+#endif
+
+#if FAULT_HANDLER_HOOKS > 0
+/**
+ * \brief Register a hook run by the handler right after the capture
+ *
+ * Hooks run in priority order, lowest value first, before any output, and
+ * equal priorities keep their registration order. Call it at init, not
+ * from an interrupt.
+ *
+ * \param hook callback, e.g. drive actuators to a safe state
+ * \param priority run order
+ * \param budget cycles allowed, 0 for no limit
+ * \return false when all #FAULT_HANDLER_HOOKS entries are used
+ */
+bool fault_handler_add_hook(fault_hook_t hook, uint32_t priority, uint32_t budget)
+{
+	uint32_t i;
+
+	if (hook == 0 || hookCount >= FAULT_HANDLER_HOOKS) {
+		return false;
+	}
+
+	for (i = hookCount; i > 0 && faultHooks[i - 1].priority > priority; i--) {
+		faultHooks[i] = faultHooks[i - 1];
+	}
+	faultHooks[i].hook = hook;
+	faultHooks[i].priority = priority;
+	faultHooks[i].budget = budget;
+	hookCount++;
+	return true;
+}
+
+/**
+ * \brief Unregister every entry of a hook
+ */
+void fault_handler_remove_hook(fault_hook_t hook)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < hookCount; i++) {
+		if (faultHooks[i].hook != hook) {
+			faultHooks[n++] = faultHooks[i];
+		}
+	}
+	hookCount = n;
+}
+
+/**
+ * \brief Poll from a long hook: true once its budget is used up
+ *
+ * A hook cannot be preempted inside HardFault, the budget is cooperative:
+ * a hook that loops, e.g. flushing a log, checks this and returns early.
+ * Overruns are recorded either way and the next hook still runs.
+ */
+bool fault_hook_expired(void)
+{
+	return hookBudget != 0 && (uint32_t)(DWT_CYCCNT - hookStart) >= hookBudget;
+}
+
+/**
+ * \brief Run the hooks and record which ones overran their budget
+ */
+static void RunHooks(fault_record_t *rec)
+{
+	bool timed = CycleCounterStart();
+	uint32_t overrun = 0;
+	uint32_t i;
+
+	for (i = 0; i < hookCount; i++) {
+		hookBudget = timed ? faultHooks[i].budget : 0;
+		hookStart = DWT_CYCCNT;
+		faultHooks[i].hook(rec);
+		if (hookBudget != 0 && (uint32_t)(DWT_CYCCNT - hookStart) > hookBudget) {
+			overrun |= 1UL << i;
+		}
+	}
+	hookBudget = 0;
+
+	/* a repeat keeps the mask of its previous occurrence if unchanged */
+	if (overrun != rec->hook_overrun) {
+		rec->hook_overrun = overrun;
+		rec->flags &= ~FAULT_FLAG_HOOK_OVERRUN;
+		if (overrun != 0) {
+			rec->flags |= FAULT_FLAG_HOOK_OVERRUN;
+		}
+#if FAULT_HANDLER_CRC
+		rec->crc = fault_record_crc(rec);
+#endif
+	}
+}
+#endif
+
+#if FAULT_HANDLER_SEPARATE_HANDLERS
+/**
+ * \brief Enable the MemManage, BusFault and UsageFault exceptions, and
+ * SecureFault on ARMv8-M Mainline
+ *
+ * Faults are then taken at \p priority instead of escalating to HardFault,
+ * so interrupts with a higher priority (lower number) keep running while
+ * the fault is captured.
+ *
+ * \param priority NVIC priority, 0 to (1 << FAULT_HANDLER_NVIC_PRIO_BITS) - 1
+ */
+void fault_handler_init(uint32_t priority)
+{
+	uint8_t shp = (uint8_t)(priority << (8 - FAULT_HANDLER_NVIC_PRIO_BITS));
+
+	SCB->SHP[0] = shp; /* MemManage, exception 4 */
+	SCB->SHP[1] = shp; /* BusFault, exception 5 */
+	SCB->SHP[2] = shp; /* UsageFault, exception 6 */
+	SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA | SCB_SHCSR_BUSFAULTENA | SCB_SHCSR_USGFAULTENA;
+#if FAULT_ARCH_V8M
+	/* RAZ/WI from Non-secure state, SecureFault then escalates to the Secure HardFault */
+	SCB->SHP[3] = shp; /* SecureFault, exception 7 */
+	SCB->SHCSR |= SCB_SHCSR_SECUREFAULTENA;
+#endif
+}
+#endif
+
+/**
+ * \brief Select where the text dump goes
+ *
+ * \param sink one of the fault_sink_* backends or an application sink
+ */
+void fault_handler_set_sink(const fault_sink_t *sink)
+{
+#if !FAULT_HANDLER_CAPTURE_ONLY
+	if (sink != 0) {
+		faultSink = sink;
+	}
+#else
+	(void)sink;
+#endif
+}
+
+/**
+ * \brief Deepest use of the dedicated fault stack so far
+ *
+ * The stack is painted by fault_handler_boot_check(); the figure is the part
+ * no longer holding the paint pattern.
+ *
+ * \return bytes used, 0 if there is no dedicated fault stack
+ */
+uint32_t fault_handler_fault_stack_used(void)
+{
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0
+	uint32_t i;
+
+	for (i = 0; i < FAULT_HANDLER_FAULT_STACK_SIZE / 4; i++) {
+		if (((uint32_t *)fault_stack)[i] != FAULT_STACK_PAINT) {
+			break;
+		}
+	}
+	return FAULT_HANDLER_FAULT_STACK_SIZE - i * 4;
+#else
+	return 0;
+#endif
+}
+
+static void BootHistoryReset(void)
+{
+	bootHistory.boot = 0;
+#if FAULT_HANDLER_LOOP_FAULTS > 0
+	bootHistory.head = 0;
+	bootHistory.count = 0;
+#endif
+	bootHistory.magic = FAULT_BOOT_MAGIC;
+}
+
+#if FAULT_HANDLER_LOOP_FAULTS > 0
+/**
+ * \brief Remember the boot and uptime of a fault that resets or halts, repeats included
+ */
+static void BootHistoryAdd(void)
+{
+	if (bootHistory.magic != FAULT_BOOT_MAGIC || bootHistory.head >= FAULT_HANDLER_LOOP_FAULTS) {
+		BootHistoryReset();
+	}
+
+	bootHistory.fault_boot[bootHistory.head] = bootHistory.boot;
+	bootHistory.fault_uptime[bootHistory.head] = (faultUptime != 0) ? faultUptime() : 0;
+	if (++bootHistory.head >= FAULT_HANDLER_LOOP_FAULTS) {
+		bootHistory.head = 0;
+	}
+	if (bootHistory.count < FAULT_HANDLER_LOOP_FAULTS) {
+		bootHistory.count++;
+	}
+}
+
+/**
+ * \brief Apply the crash loop rules to the history, after the boot count
+ */
+static bool CrashLoop(void)
+{
+	uint32_t i;
+
+	if (bootHistory.count < FAULT_HANDLER_LOOP_FAULTS) {
+		return false;
+	}
+
+	/* with a full history head is the oldest entry */
+	if (bootHistory.boot - bootHistory.fault_boot[bootHistory.head] <= FAULT_HANDLER_LOOP_BOOTS) {
+		return true;
+	}
+
+#if FAULT_HANDLER_LOOP_UPTIME_MS > 0
+	for (i = 0; i < FAULT_HANDLER_LOOP_FAULTS; i++) {
+		uint32_t e = (bootHistory.head + FAULT_HANDLER_LOOP_FAULTS - 1 - i) % FAULT_HANDLER_LOOP_FAULTS;
+		if (bootHistory.fault_boot[e] != bootHistory.boot - 1 - i ||
+		    bootHistory.fault_uptime[e] >= FAULT_HANDLER_LOOP_UPTIME_MS) {
+			return false;
+		}
+	}
+	return true;
+#else
+	(void)i;
+	return false;
+#endif
+}
+#endif
+
+/**
+ * \brief Register the uptime source stored with each fault
+ *
+ * \param uptime_ms returns milliseconds since boot, e.g. the HAL tick; it is
+ *                  called from the fault handler
+ */
+void fault_handler_set_uptime(uint32_t (*uptime_ms)(void))
+{
+	faultUptime = uptime_ms;
+}
+
+/**
+ * \brief Crash loop verdict of the last fault_handler_boot_check()
+ *
+ * \return true to skip the heavy init and enter safe mode
+ */
+bool fault_handler_safe_mode(void)
+{
+	return safeMode;
+}
+
+/**
+ * \brief Forget the fault history, e.g. after a firmware update
+ */
+void fault_handler_loop_clear(void)
+{
+	uint32_t boot = (bootHistory.magic == FAULT_BOOT_MAGIC) ? bootHistory.boot : 0;
+
+	BootHistoryReset();
+	bootHistory.boot = boot;
+	safeMode = false;
+}
+
+/**
+ * \brief Validate the retained ring after reset
+ *
+ * Call it once at boot, first thing in main. After a power-on the retained
+ * RAM holds garbage, so the whole ring is cleared when its header is not
+ * valid, and single records are dropped when their CRC does not match.
+ * The boot is counted and the crash loop rules are applied, see
+ * fault_handler_safe_mode(), and the core is prepared by fault_arch_init().
+ *
+ * \return number of records waiting to be read with fault_handler_read_record()
+ */
+uint32_t fault_handler_boot_check(void)
+{
+	uint32_t i, pending = 0;
+
+	fault_arch_init();
+
+	if (bootHistory.magic != FAULT_BOOT_MAGIC) {
+		BootHistoryReset();
+	} else {
+		bootHistory.boot++;
+	}
+#if FAULT_HANDLER_LOOP_FAULTS > 0
+	if (bootHistory.head >= FAULT_HANDLER_LOOP_FAULTS || bootHistory.count > FAULT_HANDLER_LOOP_FAULTS) {
+		BootHistoryReset();
+	}
+	safeMode = CrashLoop();
+#endif
+
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0
+	for (i = 0; i < FAULT_HANDLER_FAULT_STACK_SIZE / 4; i++) {
+		((uint32_t *)fault_stack)[i] = FAULT_STACK_PAINT;
+	}
+#endif
+
+#if FAULT_HANDLER_STATS
+	if (faultStats.magic != FAULT_STATS_MAGIC) {
+		StatsReset();
+	}
+#endif
+
+	if (fault_ring.magic != FAULT_RING_MAGIC || fault_ring.head >= FAULT_HANDLER_RING_SIZE) {
+		for (i = 0; i < FAULT_HANDLER_RING_SIZE; i++) {
+			fault_ring.slot[i].magic = 0;
+		}
+		fault_ring.seq = 0;
+		fault_ring.head = 0;
+		fault_ring.magic = FAULT_RING_MAGIC;
+		return 0;
+	}
+
+	for (i = 0; i < FAULT_HANDLER_RING_SIZE; i++) {
+		fault_record_t *rec = &fault_ring.slot[i];
+		if (rec->magic != FAULT_RECORD_MAGIC) {
+			continue;
+		}
+#if FAULT_HANDLER_CRC
+		if (!fault_record_crc_ok(rec)) {
+			rec->magic = 0;
+			continue;
+		}
+#endif
+		pending++;
+	}
+
+	return pending;
+}
+
+/**
+ * \brief Pop the oldest undrained crash record
+ *
+ * \param out where to copy the record
+ * \return true if a record was copied, false if the ring is empty
+ */
+bool fault_handler_read_record(fault_record_t *out)
+{
+	fault_record_t *oldest = 0;
+	uint32_t i;
+
+	if (fault_ring.magic != FAULT_RING_MAGIC) {
+		return false;
+	}
+
+	for (i = 0; i < FAULT_HANDLER_RING_SIZE; i++) {
+		fault_record_t *rec = &fault_ring.slot[i];
+		if (rec->magic == FAULT_RECORD_MAGIC &&
+		    (oldest == 0 || (int32_t)(rec->seq - oldest->seq) < 0)) {
+			oldest = rec;
+		}
+	}
+
+	if (oldest == 0) {
+		return false;
+	}
+
+	*out = *oldest;
+	oldest->magic = 0;
+	return true;
+}
+
+
+/*
+ * Trampolines: pick the stack the core pushed the frame on and jump to C.
+ * With FAULT_HANDLER_FULL_CONTEXT the callee-saved registers and EXC_RETURN
+ * are pushed too, before any compiled code can change them. With a fault
+ * stack MSP is switched first, the original value is pushed as ctx->msp;
+ * a fault nested in a handler already running on the fault stack keeps
+ * MSP, so the frames of the outer handler are not overwritten. On ARMv8-M
+ * Mainline only HardFault switches: the configurable fault handlers run
+ * at a priority where MSPLIM is checked, and the fault stack is outside
+ * the main stack limits.
+ *
+ * When the C handler returns (recoverable faults) the full-context variant
+ * restores r4-r11 and the original MSP and returns with EXC_RETURN; the
+ * frame-only variant tail-calls C, which returns through lr directly.
+ *
+ * ARMv6-M and ARMv8-M Baseline have no IT blocks, STMDB or MOVW, and PUSH
+ * only takes r0-r7 and lr: the stack is selected without a branch, from
+ * EXC_RETURN bit 2 turned into a mask, and r8-r11 are pushed through low
+ * registers in the same layout. The frame-only variant calls C with BL,
+ * a B may not reach it.
+ */
+#if !FAULT_ARCH_CFSR
+#if defined(__CC_ARM)
+#if FAULT_HANDLER_FULL_CONTEXT
+__asm void HardFault_Handler(void)
+{
+	MRS r1, MSP
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0
+	LDR r0, =__cpp(&fault_stack[0])
+	SUBS r0, r1, r0
+	LDR r2, =__cpp(FAULT_HANDLER_FAULT_STACK_SIZE)
+	SUBS r0, r0, r2
+	SBCS r3, r3
+	LDR r0, =__cpp(&fault_stack[FAULT_HANDLER_FAULT_STACK_SIZE / 8])
+	MOVS r2, r1
+	EORS r2, r0
+	ANDS r2, r3
+	EORS r0, r2
+	MSR MSP, r0
+#endif
+	MOV r0, r11
+	PUSH {r0, lr}
+	MOV r0, r8
+	MOV r2, r9
+	MOV r3, r10
+	PUSH {r0, r2, r3}
+	PUSH {r4-r7}
+	MRS r2, PSP
+	MOV r3, lr
+	LSLS r3, r3, #29
+	ASRS r3, r3, #31
+	MOVS r0, r2
+	EORS r0, r1
+	ANDS r0, r3
+	EORS r0, r1
+	PUSH {r0-r2}
+	MOV r0, sp
+	BL __cpp(Hard_Fault_Context_Handler)
+	LDR r0, [sp, #4]
+	ADD sp, sp, #12
+	POP {r4-r7}
+	POP {r1-r3}
+	MOV r8, r1
+	MOV r9, r2
+	MOV r10, r3
+	POP {r1, r2}
+	MOV r11, r1
+	MSR MSP, r0
+	BX r2
+}
+#else
+__asm void HardFault_Handler(void)
+{
+	MRS r0, MSP
+	MRS r2, PSP
+	MOV r1, lr
+	LSLS r3, r1, #29
+	ASRS r3, r3, #31
+	EORS r2, r0
+	ANDS r2, r3
+	EORS r0, r2
+	PUSH {r1, lr}
+	BL __cpp(Hard_Fault_Handler)
+	POP {r2, r3}
+	BX r3
+}
+#endif
+#elif defined(__ICCARM__)
+#if FAULT_HANDLER_FULL_CONTEXT
+__stackless void HardFault_Handler(void)
+{
+	__asm("MRS r1, MSP");
+	__asm("MOV r0, r11");
+	__asm("PUSH {r0, lr}");
+	__asm("MOV r0, r8");
+	__asm("MOV r2, r9");
+	__asm("MOV r3, r10");
+	__asm("PUSH {r0, r2, r3}");
+	__asm("PUSH {r4-r7}");
+	__asm("MRS r2, PSP");
+	__asm("MOV r3, lr");
+	__asm("LSLS r3, r3, #29");
+	__asm("ASRS r3, r3, #31");
+	__asm("MOVS r0, r2");
+	__asm("EORS r0, r0, r1");
+	__asm("ANDS r0, r0, r3");
+	__asm("EORS r0, r0, r1");
+	__asm("PUSH {r0-r2}");
+	__asm("MOV r0, sp");
+	__asm("BL Hard_Fault_Context_Handler");
+	__asm("LDR r0, [sp, #4]");
+	__asm("ADD sp, sp, #12");
+	__asm("POP {r4-r7}");
+	__asm("POP {r1-r3}");
+	__asm("MOV r8, r1");
+	__asm("MOV r9, r2");
+	__asm("MOV r10, r3");
+	__asm("POP {r1, r2}");
+	__asm("MOV r11, r1");
+	__asm("MSR MSP, r0");
+	__asm("BX r2");
+}
+#else
+__stackless void HardFault_Handler(void)
+{
+	__asm("MRS r0, MSP");
+	__asm("MRS r2, PSP");
+	__asm("MOV r1, lr");
+	__asm("LSLS r3, r1, #29");
+	__asm("ASRS r3, r3, #31");
+	__asm("EORS r2, r2, r0");
+	__asm("ANDS r2, r2, r3");
+	__asm("EORS r0, r0, r2");
+	__asm("PUSH {r1, lr}");
+	__asm("BL Hard_Fault_Handler");
+	__asm("POP {r2, r3}");
+	__asm("BX r3");
+}
+#endif
+#elif defined(__GNUC__)
+#if FAULT_HANDLER_FULL_CONTEXT
+__attribute__((naked)) void HardFault_Handler(void)
+{
+	__asm volatile(
+		"MRS r1, MSP                        \n"
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0
+		/* r3 = ~0 when MSP is already inside the fault stack */
+		"LDR r0, =fault_stack               \n"
+		"SUBS r0, r1, r0                    \n"
+		"LDR r2, =" FAULT_XSTR(FAULT_HANDLER_FAULT_STACK_SIZE) "\n"
+		"SUBS r0, r0, r2                    \n"
+		"SBCS r3, r3                        \n"
+		"LDR r0, =fault_stack+" FAULT_XSTR(FAULT_HANDLER_FAULT_STACK_SIZE) "\n"
+		"MOVS r2, r1                        \n"
+		"EORS r2, r0                        \n"
+		"ANDS r2, r3                        \n"
+		"EORS r0, r2                        \n"
+		"MSR MSP, r0                        \n"
+#endif
+		"MOV r0, r11                        \n"
+		"PUSH {r0, lr}                      \n"
+		"MOV r0, r8                         \n"
+		"MOV r2, r9                         \n"
+		"MOV r3, r10                        \n"
+		"PUSH {r0, r2, r3}                  \n"
+		"PUSH {r4-r7}                       \n"
+		"MRS r2, PSP                        \n"
+		"MOV r3, lr                         \n"
+		"LSLS r3, r3, #29                   \n"
+		"ASRS r3, r3, #31                   \n"
+		"MOVS r0, r2                        \n"
+		"EORS r0, r1                        \n"
+		"ANDS r0, r3                        \n"
+		"EORS r0, r1                        \n"
+		"PUSH {r0-r2}                       \n"
+		"MOV r0, sp                         \n"
+		"BL Hard_Fault_Context_Handler      \n"
+		"LDR r0, [sp, #4]                   \n"
+		"ADD sp, sp, #12                    \n"
+		"POP {r4-r7}                        \n"
+		"POP {r1-r3}                        \n"
+		"MOV r8, r1                         \n"
+		"MOV r9, r2                         \n"
+		"MOV r10, r3                        \n"
+		"POP {r1, r2}                       \n"
+		"MOV r11, r1                        \n"
+		"MSR MSP, r0                        \n"
+		"BX r2                              \n"
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0
+		".ltorg                             \n"
+#endif
+	);
+}
+#else
+__attribute__((naked)) void HardFault_Handler(void)
+{
+	__asm volatile(
+		"MRS r0, MSP                        \n"
+		"MRS r2, PSP                        \n"
+		"MOV r1, lr                         \n"
+		"LSLS r3, r1, #29                   \n"
+		"ASRS r3, r3, #31                   \n"
+		"EORS r2, r0                        \n"
+		"ANDS r2, r3                        \n"
+		"EORS r0, r2                        \n"
+		"PUSH {r1, lr}                      \n"
+		"BL Hard_Fault_Handler              \n"
+		"POP {r2, r3}                       \n"
+		"BX r3                              \n"
+	);
+}
+#endif
+#else
+#warning Not supported compiler type
+#endif
+#elif defined(__CC_ARM)
+#if FAULT_HANDLER_FULL_CONTEXT
+__asm void HardFault_Handler(void)
+{
+#if FAULT_HANDLER_BENCH
+	LDR r3, =0xE0001004
+	LDR r3, [r3]
+	LDR r12, =__cpp(&fault_bench)
+	STR r3, [r12]
+#endif
+	MRS r1, MSP
+	MRS r2, PSP
+	TST lr, #4
+	ITE EQ
+	MOVEQ r0, r1
+	MOVNE r0, r2
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0
+	LDR r3, =__cpp(&fault_stack[0])
+	SUB r12, r1, r3
+	LDR r3, =__cpp(FAULT_HANDLER_FAULT_STACK_SIZE)
+	CMP r12, r3
+	LDR r3, =__cpp(&fault_stack[FAULT_HANDLER_FAULT_STACK_SIZE / 8])
+	IT HS
+	MSRHS MSP, r3
+#endif
+	STMDB sp!, {r0-r2, r4-r11, lr}
+	MOV r0, sp
+	BL __cpp(Hard_Fault_Context_Handler)
+	LDR r0, [sp, #4]
+	ADD sp, sp, #12
+	LDMIA sp!, {r4-r11, lr}
+	MSR MSP, r0
+	BX lr
+}
+#else
+__asm void HardFault_Handler(void)
+{
+#if FAULT_HANDLER_BENCH
+	LDR r3, =0xE0001004
+	LDR r3, [r3]
+	LDR r12, =__cpp(&fault_bench)
+	STR r3, [r12]
+#endif
+	TST lr, #4
+	ITE EQ
+	MRSEQ r0, MSP
+	MRSNE r0, PSP
+	MOV r1, lr
+	B __cpp(Hard_Fault_Handler)
+}
+#endif
+#elif defined(__ICCARM__)
+#if FAULT_HANDLER_BENCH
+#define FAULT_BENCH_ENTRY()	__asm("MOVW r3, #0x1004");               \
+				__asm("MOVT r3, #0xE000");               \
+				__asm("LDR r3, [r3]");                   \
+				__asm("MOVW r12, #LWRD(fault_bench)");   \
+				__asm("MOVT r12, #HWRD(fault_bench)");   \
+				__asm("STR r3, [r12]")
+#else
+#define FAULT_BENCH_ENTRY()
+#endif
+/* __stackless: no compiler prologue or epilogue around the trampoline */
+#if FAULT_HANDLER_FULL_CONTEXT
+__stackless void HardFault_Handler(void)
+{
+	FAULT_BENCH_ENTRY();
+	__asm("MRS r1, MSP");
+	__asm("MRS r2, PSP");
+	__asm("TST lr, #4");
+	__asm("ITE EQ");
+	__asm("MOVEQ r0, r1");
+	__asm("MOVNE r0, r2");
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0
+	__asm("MOVW r3, #LWRD(fault_stack)");
+	__asm("MOVT r3, #HWRD(fault_stack)");
+	__asm("SUB r12, r1, r3");
+#if FAULT_ARCH_V8M
+	__asm("MRS r3, IPSR");
+	__asm("CMP r3, #3");
+	__asm("IT NE");
+	__asm("MOVNE r12, #0");
+#endif
+	__asm("MOVW r3, #" FAULT_XSTR(FAULT_HANDLER_FAULT_STACK_SIZE));
+	__asm("CMP r12, r3");
+	__asm("MOVW r3, #LWRD(fault_stack + " FAULT_XSTR(FAULT_HANDLER_FAULT_STACK_SIZE) ")");
+	__asm("MOVT r3, #HWRD(fault_stack + " FAULT_XSTR(FAULT_HANDLER_FAULT_STACK_SIZE) ")");
+	__asm("IT HS");
+	__asm("MSRHS MSP, r3");
+#endif
+	__asm("STMDB sp!, {r0-r2, r4-r11, lr}");
+	__asm("MOV r0, sp");
+	__asm("BL Hard_Fault_Context_Handler");
+	__asm("LDR r0, [sp, #4]");
+	__asm("ADD sp, sp, #12");
+	__asm("LDMIA sp!, {r4-r11, lr}");
+	__asm("MSR MSP, r0");
+	__asm("BX lr");
+}
+#else
+__stackless void HardFault_Handler(void)
+{
+	FAULT_BENCH_ENTRY();
+	__asm("TST lr, #4");
+	__asm("ITE EQ");
+	__asm("MRSEQ r0, MSP");
+	__asm("MRSNE r0, PSP");
+	__asm("MOV r1, lr");
+	__asm("B Hard_Fault_Handler");
+}
+#endif
+#elif defined(__GNUC__)
+/* Naked: no compiler prologue, nothing touches the stack before the STMDB */
+#if FAULT_HANDLER_BENCH
+/* r3 and r12 are already stacked by the core, free to use */
+#define FAULT_BENCH_ENTRY                   \
+		"MOVW r3, #0x1004                   \n" \
+		"MOVT r3, #0xE000                   \n" \
+		"LDR r3, [r3]                       \n" \
+		"MOVW r12, #:lower16:fault_bench    \n" \
+		"MOVT r12, #:upper16:fault_bench    \n" \
+		"STR r3, [r12]                      \n"
+#else
+#define FAULT_BENCH_ENTRY
+#endif
+#if FAULT_HANDLER_FULL_CONTEXT
+__attribute__((naked)) void HardFault_Handler(void)
+{
+	__asm volatile(
+		FAULT_BENCH_ENTRY
+		"MRS r1, MSP                        \n"
+		"MRS r2, PSP                        \n"
+		"TST lr, #4                         \n"
+		"ITE EQ                             \n"
+		"MOVEQ r0, r1                       \n"
+		"MOVNE r0, r2                       \n"
+#if FAULT_HANDLER_FAULT_STACK_SIZE > 0
+		/* HS: MSP is not inside the fault stack yet */
+		"MOVW r3, #:lower16:fault_stack     \n"
+		"MOVT r3, #:upper16:fault_stack     \n"
+		"SUB r12, r1, r3                    \n"
+#if FAULT_ARCH_V8M
+		/* a configurable fault runs where MSPLIM applies: stays on MSP */
+		"MRS r3, IPSR                       \n"
+		"CMP r3, #3                         \n"
+		"IT NE                              \n"
+		"MOVNE r12, #0                      \n"
+#endif
+		"MOVW r3, #" FAULT_XSTR(FAULT_HANDLER_FAULT_STACK_SIZE) "\n"
+		"CMP r12, r3                        \n"
+		"MOVW r3, #:lower16:fault_stack+" FAULT_XSTR(FAULT_HANDLER_FAULT_STACK_SIZE) "\n"
+		"MOVT r3, #:upper16:fault_stack+" FAULT_XSTR(FAULT_HANDLER_FAULT_STACK_SIZE) "\n"
+		"IT HS                              \n"
+		"MSRHS MSP, r3                      \n"
+#endif
+		"STMDB sp!, {r0-r2, r4-r11, lr}     \n"
+		"MOV r0, sp                         \n"
+		"BL Hard_Fault_Context_Handler      \n"
+		"LDR r0, [sp, #4]                   \n"
+		"ADD sp, sp, #12                    \n"
+		"LDMIA sp!, {r4-r11, lr}            \n"
+		"MSR MSP, r0                        \n"
+		"BX lr                              \n"
+	);
+}
+#else
+__attribute__((naked)) void HardFault_Handler(void)
+{
+	__asm volatile(
+		FAULT_BENCH_ENTRY
+		"TST lr, #4                         \n"
+		"ITE EQ                             \n"
+		"MRSEQ r0, MSP                      \n"
+		"MRSNE r0, PSP                      \n"
+		"MOV r1, lr                         \n"
+		"B Hard_Fault_Handler               \n"
+	);
+}
+#endif
+#else
+#warning Not supported compiler type
+#endif
+
+#if FAULT_HANDLER_SEPARATE_HANDLERS
+/*
+ * Configurable fault entry points: lr and the registers are untouched, so a
+ * branch to the HardFault trampoline captures exactly the same state. The C
+ * code tells the exceptions apart through ICSR.VECTACTIVE.
+ */
+#if defined(__CC_ARM)
+__asm void MemManage_Handler(void)
+{
+	B __cpp(HardFault_Handler)
+}
+__asm void BusFault_Handler(void)
+{
+	B __cpp(HardFault_Handler)
+}
+__asm void UsageFault_Handler(void)
+{
+	B __cpp(HardFault_Handler)
+}
+#elif defined(__ICCARM__)
+__stackless void MemManage_Handler(void)
+{
+	__asm("B HardFault_Handler");
+}
+__stackless void BusFault_Handler(void)
+{
+	__asm("B HardFault_Handler");
+}
+__stackless void UsageFault_Handler(void)
+{
+	__asm("B HardFault_Handler");
+}
+#if FAULT_ARCH_V8M
+__stackless void SecureFault_Handler(void)
+{
+	__asm("B HardFault_Handler");
+}
+#endif
+#elif defined(__GNUC__)
+__attribute__((naked)) void MemManage_Handler(void)
+{
+	__asm volatile("B HardFault_Handler\n");
+}
+__attribute__((naked)) void BusFault_Handler(void)
+{
+	__asm volatile("B HardFault_Handler\n");
+}
+__attribute__((naked)) void UsageFault_Handler(void)
+{
+	__asm volatile("B HardFault_Handler\n");
+}
+#if FAULT_ARCH_V8M
+__attribute__((naked)) void SecureFault_Handler(void)
+{
+	__asm volatile("B HardFault_Handler\n");
+}
+#endif
+#endif
+#endif
+
 
 
 /*
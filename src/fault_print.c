@@ -0,0 +1,387 @@
+/**
+ * \file
+ * \brief Crash record output
+ *
+ * Text dump of a crash record, shared by the handler and the host decoder,
+ * and the raw write loop used by every output mode.
+ */
+#include <string.h>
+#include "fault_handler.h"
+#include "fault_decode.h"
+
+#if !FAULT_HANDLER_CAPTURE_ONLY
+
+#if FAULT_HANDLER_TEXT
+/*
+ * Private Functions
+ */
+static void printErrorMsg(const char * errMsg);
+static void printHex(const char *prefix, uint32_t value, uint32_t digits, const char *table, const char *suffix);
+#if FAULT_HANDLER_DECODE
+static void printFaultClassMsg(uint32_t CFSRValue, fault_class_t cls, uint32_t address);
+#endif
+static void DumpStack(const fault_record_t *rec);
+#if FAULT_ARCH_V8M
+static void DumpSecure(const fault_record_t *rec);
+#endif
+#if FAULT_HANDLER_RTOS
+static void DumpTasks(const fault_record_t *rec);
+static void printTask(const char *prefix, const fault_task_record_t *task);
+#endif
+
+static const char hexLower[16] = {'0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'};
+#if FAULT_HANDLER_DECODE
+static const char hexUpper[16] = {'0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F'};
+#endif
+
+static const char * const faultTitles[4] = {
+	"MemManage Fault!!!\n",
+	"Bus Fault!!!\n",
+	"Usage Fault!!!\n",
+	"Secure Fault!!!\n",
+};
+
+/** Indexed by fault_action_t */
+static const char * const actionMsgs[4] = {
+	"Halted\n",
+	"Resetting\n",
+	"Resuming at landing function\n",
+	"Resuming after faulting instruction\n",
+};
+
+static const fault_sink_t *printSink;
+#endif
+
+/**
+ * \brief Send raw bytes to a sink
+ *
+ * Whatever the sink cannot take is dropped, it never blocks forever.
+ *
+ * \param sink output sink
+ * \param buf bytes to send
+ * \param len number of bytes
+ */
+void fault_write(const fault_sink_t *sink, const void *buf, uint32_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len > 0) {
+		uint32_t n = sink->write(p, len);
+		if (n == 0) {
+			break;
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+#if FAULT_HANDLER_TEXT
+/**
+ * \brief Print the text dump of a crash record
+ *
+ * This is the text the handler prints on target; the host decoder calls it
+ * on records read back from the device, so both always agree.
+ *
+ * \param rec crash record
+ * \param sink output sink
+ */
+void fault_print_record(const fault_record_t *rec, const fault_sink_t *sink)
+{
+#if FAULT_HANDLER_DECODE
+	uint32_t bits;
+#endif
+
+	printSink = sink;
+
+	if (rec->exception >= 4 && rec->exception <= 7) {
+		/* taken directly, no escalation to decode */
+		printErrorMsg(faultTitles[rec->exception - 4]);
+	} else {
+		printErrorMsg("Hard Fault!!!\n");
+#if FAULT_ARCH_CFSR
+		printHex("SCB->HFSR = 0x", rec->hfsr, 8, hexLower, "\n");
+#endif
+
+#if FAULT_HANDLER_DECODE
+		bits = rec->hfsr;
+		while (bits != 0) {
+			printErrorMsg(fault_strings[fault_hfsr_bits[fault_ctz(bits)]]);
+			bits &= bits - 1;
+		}
+#endif
+	}
+
+	if ((rec->exception >= 4 && rec->exception <= 6) || (rec->hfsr & (1 << 30)) != 0) {
+		printHex("SCB->CFSR = 0x", rec->cfsr, 8, hexLower, "\n");
+#if FAULT_HANDLER_DECODE
+		printFaultClassMsg(rec->cfsr, FAULT_CLASS_USAGE, 0);
+		printFaultClassMsg(rec->cfsr, FAULT_CLASS_BUS, rec->bfar);
+		printFaultClassMsg(rec->cfsr, FAULT_CLASS_MEMMANAGE, rec->mmfar);
+#else
+		/* codes only: the addresses, when MMARVALID / BFARVALID say so */
+		if ((rec->cfsr & (1 << 7)) != 0) {
+			printHex("MMFAR = 0x", rec->mmfar, 8, hexLower, "\n");
+		}
+		if ((rec->cfsr & (1 << 15)) != 0) {
+			printHex("BFAR = 0x", rec->bfar, 8, hexLower, "\n");
+		}
+#endif
+	}
+#if FAULT_ARCH_V8M
+	if ((rec->flags & FAULT_FLAG_V8M) != 0) {
+		DumpSecure(rec);
+	}
+#endif
+
+	DumpStack(rec);
+#if FAULT_HANDLER_RTOS
+	DumpTasks(rec);
+#endif
+
+	if (rec->count > 1) {
+		printHex("Occurrences = 0x", rec->count, 8, hexLower, "\n");
+	}
+#if FAULT_HANDLER_HOOKS > 0
+	if ((rec->flags & FAULT_FLAG_HOOK_OVERRUN) != 0) {
+		printHex("Hooks over budget, by run order = 0x", rec->hook_overrun, 8, hexLower, "\n");
+	}
+#endif
+
+	if (rec->action < sizeof(actionMsgs) / sizeof(actionMsgs[0])) {
+		printErrorMsg(actionMsgs[rec->action]);
+	}
+}
+
+/**
+ * \brief Print Messages through the current sink
+ */
+static void printErrorMsg(const char * errMsg)
+{
+	fault_write(printSink, errMsg, strlen(errMsg));
+}
+
+/**
+ * \brief Print a value as fixed-width hex, without libc formatting
+ *
+ * One table lookup per nibble, so the cost only depends on \p digits.
+ *
+ * \param prefix text before the value
+ * \param value value to print
+ * \param digits number of nibbles to print, 1 to 8
+ * \param table hexLower or hexUpper
+ * \param suffix text after the value
+ */
+static void printHex(const char *prefix, uint32_t value, uint32_t digits, const char *table, const char *suffix)
+{
+	char buf[8];
+	uint32_t i = digits;
+
+	while (i > 0) {
+		buf[--i] = table[value & 0xF];
+		value >>= 4;
+	}
+
+	printErrorMsg(prefix);
+	fault_write(printSink, buf, digits);
+	printErrorMsg(suffix);
+}
+
+#if FAULT_HANDLER_DECODE
+/**
+ * \brief Print the errors of one CFSR sub-register
+ *
+ * Walks the set bits with count-trailing-zeros over the shared decode table,
+ * or in the fixed order of the class when it has one; nothing is printed
+ * when no bit of the class is set.
+ *
+ * \param CFSRValue SCB->CFSR
+ * \param cls sub-register to print
+ * \param address BFAR or MMFAR, printed when its valid flag is set
+ */
+static void printFaultClassMsg(uint32_t CFSRValue, fault_class_t cls, uint32_t address)
+{
+	const fault_class_desc_t *desc = &fault_classes[cls];
+	uint32_t bits = CFSRValue & desc->mask;
+	uint32_t i;
+
+	if (bits == 0) {
+		return;
+	}
+
+	if (desc->show_value) {
+		/* same width as "%.2X": significant digits, at least two */
+		uint32_t digits = 0;
+		uint32_t high;
+		for (high = bits; high != 0; high >>= 4) {
+			digits++;
+		}
+		printHex(fault_strings[desc->title], bits, (digits < 2) ? 2 : digits, hexUpper, "\n");
+	} else {
+		printErrorMsg(fault_strings[desc->title]);
+	}
+
+	for (i = 0; bits != 0; i++) {
+		uint32_t n = (desc->order != 0) ? desc->order[i] : fault_ctz(bits);
+		const fault_bit_t *bit = &fault_cfsr_bits[n];
+
+		if ((bits & (1UL << n)) == 0) {
+			continue;
+		}
+		if ((bit->flags & FAULT_BIT_ADDRESS) != 0) {
+			printHex(fault_strings[bit->str], address, 8, hexUpper, "\n");
+		} else {
+			printErrorMsg(fault_strings[bit->str]);
+		}
+		bits &= ~(1UL << n);
+	}
+}
+#endif
+
+#if FAULT_ARCH_V8M
+/**
+ * \brief SecureFault status and stack limits of ARMv8-M Mainline
+ *
+ * SFSR reads 0 when the handler runs in Non-secure state, nothing is printed
+ * for it then.
+ */
+static void DumpSecure(const fault_record_t *rec)
+{
+	if (rec->sfsr != 0) {
+		printHex("SAU->SFSR = 0x", rec->sfsr, 8, hexLower, "\n");
+#if FAULT_HANDLER_DECODE
+		{
+			uint32_t bits = rec->sfsr & 0xFF;
+
+			printErrorMsg(fault_strings[FAULT_STR_SECURE_TITLE]);
+			while (bits != 0) {
+				uint32_t bit = fault_ctz(bits);
+
+				if (bit == 6) {
+					printHex(fault_strings[fault_sfsr_bits[bit]], rec->sfar, 8, hexUpper, "\n");
+				} else {
+					printErrorMsg(fault_strings[fault_sfsr_bits[bit]]);
+				}
+				bits &= bits - 1;
+			}
+		}
+#else
+		/* codes only: the address, when SFARVALID says so */
+		if ((rec->sfsr & (1 << 6)) != 0) {
+			printHex("SFAR = 0x", rec->sfar, 8, hexLower, "\n");
+		}
+#endif
+	}
+	printHex("MSPLIM = 0x", rec->msplim, 8, hexLower, "\n");
+	printHex("PSPLIM = 0x", rec->psplim, 8, hexLower, "\n");
+}
+#endif
+
+/**
+ * \brief Dump Stack, printing all registers ARM core pushes on stack on hard fault exception
+ */
+static void DumpStack(const fault_record_t *rec)
+{
+	uint32_t code_address_error;
+	printHex("\nr0  = 0x", rec->r0, 8, hexLower, "\n");
+	printHex("r1  = 0x", rec->r1, 8, hexLower, "\n");
+	printHex("r2  = 0x", rec->r2, 8, hexLower, "\n");
+	printHex("r3  = 0x", rec->r3, 8, hexLower, "\n");
+	printHex("r12 = 0x", rec->r12, 8, hexLower, "\n");
+	printHex("lr  = 0x", rec->lr, 8, hexLower, "\n");
+	printHex("pc  = 0x", rec->pc, 8, hexLower, "\n");
+	printHex("psr = 0x", rec->psr, 8, hexLower, "\n");
+
+	if (rec->pc == 0) {
+		code_address_error = rec->lr;
+	} else {
+		code_address_error = rec->pc;
+	}
+
+	printHex("\n--\t--\t--\nHard fault occurred at address 0x", code_address_error, 8, hexLower,
+	         ".\nFind high-level function with\nDisassembly window or Map file\n--\t--\t--\n");
+
+#if FAULT_HANDLER_FPU
+	if ((rec->flags & FAULT_FLAG_FP_REGS) != 0) {
+		uint32_t i;
+
+		printHex("fpscr = 0x", rec->fpscr, 8, hexLower, "\ns0-s15:");
+		for (i = 0; i < 16; i++) {
+			printHex(((i & 3) == 0) ? "\n  " : " ", rec->s[i], 8, hexLower, "");
+		}
+		printErrorMsg("\n");
+	} else if ((rec->flags & FAULT_FLAG_FP_FRAME) != 0) {
+		printErrorMsg("FP state not stacked yet (lazy stacking), not captured\n");
+	}
+#endif
+
+#if FAULT_HANDLER_BACKTRACE_DEPTH > 0
+	if (rec->backtrace_count > 0 && rec->backtrace_count <= FAULT_HANDLER_BACKTRACE_DEPTH) {
+		uint32_t i;
+
+		printErrorMsg("Possible callers:\n");
+		for (i = 0; i < rec->backtrace_count; i++) {
+			printHex("  0x", rec->backtrace[i], 8, hexLower, "\n");
+		}
+	}
+#endif
+
+#if FAULT_HANDLER_STACK_SNAPSHOT > 0
+	if (rec->snapshot_count > 0 && rec->snapshot_count <= FAULT_HANDLER_STACK_SNAPSHOT) {
+		uint32_t i;
+
+		printHex("Stack at 0x", rec->snapshot_addr, 8, hexLower, ":");
+		for (i = 0; i < rec->snapshot_count; i++) {
+			printHex(((i & 3) == 0) ? "\n  " : " ", rec->snapshot[i], 8, hexLower, "");
+		}
+		printErrorMsg("\n");
+	}
+#endif
+}
+
+#if FAULT_HANDLER_RTOS
+/**
+ * \brief Print the faulting task and the stack table
+ */
+static void DumpTasks(const fault_record_t *rec)
+{
+	uint32_t i;
+
+	if ((rec->flags & FAULT_FLAG_TASK) != 0) {
+		printTask("Faulting task ", &rec->task);
+	}
+
+	if (rec->task_count > 0 && rec->task_count <= FAULT_HANDLER_RTOS_TASKS) {
+		printErrorMsg("Task stacks:\n");
+		for (i = 0; i < rec->task_count; i++) {
+			printTask("  ", &rec->tasks[i]);
+		}
+	}
+}
+
+/**
+ * \brief One task line, flagged when its stack overflowed
+ */
+static void printTask(const char *prefix, const fault_task_record_t *task)
+{
+	uint32_t len = 0;
+
+	while (len < FAULT_TASK_NAME_SIZE && task->name[len] != '\0') {
+		len++;
+	}
+
+	printHex(prefix, task->id, 2, hexLower, " ");
+	fault_write(printSink, task->name, len);
+	printHex(": sp = 0x", task->sp, 8, hexLower, "");
+	printHex(", base = 0x", task->base, 8, hexLower, "");
+	if (task->unused != FAULT_TASK_UNKNOWN) {
+		printHex(", unused = 0x", task->unused, 8, hexLower, "");
+	}
+	if (task->sp < task->base || task->unused == 0) {
+		printErrorMsg(", STACK OVERFLOW");
+	}
+	printErrorMsg("\n");
+}
+#endif
+#endif /* FAULT_HANDLER_TEXT */
+
+#endif /* !FAULT_HANDLER_CAPTURE_ONLY */
@@ -0,0 +1,109 @@
+/**
+ * \file
+ * \brief FreeRTOS adapter for the task capture
+ *
+ * The kernel task lists are private to tasks.c and walking them takes the
+ * scheduler lock, so the tasks are tracked from traceTASK_CREATE and
+ * traceTASK_DELETE (see fault_rtos.h), which run in a critical section.
+ * Needs in FreeRTOSConfig.h: INCLUDE_xTaskGetCurrentTaskHandle,
+ * INCLUDE_xTaskGetSchedulerState, INCLUDE_uxTaskGetStackHighWaterMark and
+ * INCLUDE_pxTaskGetStackStart set to 1. The high-water mark needs the stack
+ * fill, on with configCHECK_FOR_STACK_OVERFLOW > 1.
+ */
+#include "fault_handler.h"
+
+#if FAULT_HANDLER_RTOS == FAULT_RTOS_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*
+ * Private Functions
+ */
+static bool Current(fault_task_t *task);
+static bool Task(uint32_t index, fault_task_t *task);
+static void Describe(TaskHandle_t handle, uint32_t id, fault_task_t *task);
+
+/** Live tasks, by creation slot; the slot is the task id */
+static TaskHandle_t volatile freertosTasks[FAULT_HANDLER_RTOS_TASKS];
+
+const fault_rtos_t fault_rtos_freertos = { Current, Task };
+
+
+/**
+ * \brief traceTASK_CREATE hook
+ *
+ * Tasks created once the table is full are not recorded.
+ */
+void fault_freertos_task_created(void *task)
+{
+	uint32_t i;
+
+	for (i = 0; i < FAULT_HANDLER_RTOS_TASKS; i++) {
+		if (freertosTasks[i] == NULL) {
+			freertosTasks[i] = (TaskHandle_t)task;
+			return;
+		}
+	}
+}
+
+/**
+ * \brief traceTASK_DELETE hook
+ */
+void fault_freertos_task_deleted(void *task)
+{
+	uint32_t i;
+
+	for (i = 0; i < FAULT_HANDLER_RTOS_TASKS; i++) {
+		if (freertosTasks[i] == (TaskHandle_t)task) {
+			freertosTasks[i] = NULL;
+		}
+	}
+}
+
+static bool Current(fault_task_t *task)
+{
+	TaskHandle_t handle;
+	uint32_t i;
+
+	if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+		return false;
+	}
+	handle = xTaskGetCurrentTaskHandle();
+	if (handle == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < FAULT_HANDLER_RTOS_TASKS && freertosTasks[i] != handle; i++) {
+	}
+	Describe(handle, i, task);
+	return true;
+}
+
+static bool Task(uint32_t index, fault_task_t *task)
+{
+	uint32_t i;
+
+	if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+		return false;
+	}
+
+	for (i = 0; i < FAULT_HANDLER_RTOS_TASKS; i++) {
+		TaskHandle_t handle = freertosTasks[i];
+		if (handle != NULL && index-- == 0) {
+			Describe(handle, i, task);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void Describe(TaskHandle_t handle, uint32_t id, fault_task_t *task)
+{
+	task->id = id;
+	task->name = pcTaskGetName(handle);
+	/* pxTopOfStack is the first member of the TCB, by FreeRTOS contract */
+	task->sp = (uintptr_t)*(StackType_t * volatile *)handle;
+	task->base = (uintptr_t)pxTaskGetStackStart(handle);
+	task->unused = (uint32_t)uxTaskGetStackHighWaterMark(handle) * sizeof(StackType_t);
+}
+#endif
@@ -0,0 +1,87 @@
+/**
+ * \file
+ * \brief Zephyr adapter for the task capture
+ *
+ * Threads are walked with k_thread_foreach_unlocked(), which still takes
+ * z_thread_monitor_lock around each step: harmless on a single core, where
+ * the spinlock only masks interrupts.
+ * Needs CONFIG_THREAD_MONITOR and CONFIG_THREAD_STACK_INFO; CONFIG_INIT_STACKS
+ * for the high-water mark and CONFIG_THREAD_NAME for the names. Leave
+ * CONFIG_SPIN_VALIDATE off: it asserts when the fault hit while the monitor
+ * lock was held. The fault vectors must be routed to this handler instead
+ * of the kernel's.
+ */
+#include "fault_handler.h"
+
+#if FAULT_HANDLER_RTOS == FAULT_RTOS_ZEPHYR
+#include <zephyr/kernel.h>
+
+typedef struct {
+	uint32_t index;               /**< Thread wanted by position, or UINT32_MAX  */
+	const struct k_thread *match; /**< Thread wanted by address, or NULL         */
+	uint32_t seen;                /**< Threads walked so far                     */
+	uint32_t found;               /**< Position of the thread found              */
+	struct k_thread *thread;      /**< Thread found, NULL if none                */
+} walk_t;
+
+/*
+ * Private Functions
+ */
+static bool Current(fault_task_t *task);
+static bool Task(uint32_t index, fault_task_t *task);
+static void Walk(const struct k_thread *thread, void *arg);
+static void Describe(struct k_thread *thread, uint32_t id, fault_task_t *task);
+
+const fault_rtos_t fault_rtos_zephyr = { Current, Task };
+
+
+static bool Current(fault_task_t *task)
+{
+	walk_t walk = { UINT32_MAX, NULL, 0, 0, NULL };
+
+	walk.match = k_current_get();
+	if (walk.match == NULL) {
+		return false;
+	}
+	k_thread_foreach_unlocked(Walk, &walk);
+	Describe((struct k_thread *)walk.match, (walk.thread != NULL) ? walk.found : UINT32_MAX, task);
+	return true;
+}
+
+static bool Task(uint32_t index, fault_task_t *task)
+{
+	walk_t walk = { index, NULL, 0, 0, NULL };
+
+	k_thread_foreach_unlocked(Walk, &walk);
+	if (walk.thread == NULL) {
+		return false;
+	}
+	Describe(walk.thread, walk.found, task);
+	return true;
+}
+
+/**
+ * \brief k_thread_foreach_unlocked() callback, no early exit is possible
+ */
+static void Walk(const struct k_thread *thread, void *arg)
+{
+	walk_t *walk = arg;
+
+	if (walk->thread == NULL && (walk->seen == walk->index || thread == walk->match)) {
+		walk->thread = (struct k_thread *)thread;
+		walk->found = walk->seen;
+	}
+	walk->seen++;
+}
+
+static void Describe(struct k_thread *thread, uint32_t id, fault_task_t *task)
+{
+	size_t unused;
+
+	task->id = id;
+	task->name = k_thread_name_get(thread);
+	task->sp = (uintptr_t)thread->callee_saved.psp;
+	task->base = (uintptr_t)thread->stack_info.start;
+	task->unused = (k_thread_stack_space_get(thread, &unused) == 0) ? (uint32_t)unused : FAULT_TASK_UNKNOWN;
+}
+#endif
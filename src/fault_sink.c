@@ -0,0 +1,236 @@
+/**
+ * \file
+ * \brief Output sinks for the fault handler
+ *
+ * Backends for the text dump: semihosting, ITM/SWO, an RTT-style memory
+ * buffer and a polled UART. Register one with fault_handler_set_sink().
+ * Every wait is bounded by #FAULT_SINK_SPIN_LIMIT, so a sink never hangs the
+ * handler when no debugger or cable is attached.
+ */
+#include <stdio.h>
+#include "fault_sink.h"
+
+/*
+ * Private defines
+ */
+
+#define ITM_PORT8(n)    (*((volatile uint8_t *)(0xE0000000UL + 4 * (n))))  /**< ITM stimulus port, byte access */
+#define ITM_PORT32(n)   (*((volatile uint32_t *)(0xE0000000UL + 4 * (n)))) /**< ITM stimulus port, word access */
+#define ITM_TER         (*((volatile uint32_t *)0xE0000E00UL))             /**< ITM Trace Enable Register      */
+#define ITM_TCR         (*((volatile uint32_t *)0xE0000E80UL))             /**< ITM Trace Control Register     */
+#define DEMCR           (*((volatile uint32_t *)0xE000EDFCUL))             /**< Debug Exception and Monitor Control Register */
+
+#define ITM_TCR_ITMENA  ((uint32_t)0x00000001) /**< ITM enable */
+#define DEMCR_TRCENA    ((uint32_t)0x01000000) /**< Trace enable */
+
+#if defined(__CC_ARM) || defined(__ICCARM__) || defined(__GNUC__)
+#define DMB()           __asm volatile("DMB")
+#else
+#define DMB()
+#endif
+
+/*
+ * Private Functions
+ */
+static uint32_t SemihostWrite(const void *buf, uint32_t len);
+static void SemihostFlush(void);
+static uint32_t ItmWrite(const void *buf, uint32_t len);
+static void ItmFlush(void);
+static uint32_t RttWrite(const void *buf, uint32_t len);
+static void RttFlush(void);
+static uint32_t UartWrite(const void *buf, uint32_t len);
+static void UartFlush(void);
+
+/*
+ * Public data
+ */
+const fault_sink_t fault_sink_semihost = { SemihostWrite, SemihostFlush };
+const fault_sink_t fault_sink_itm = { ItmWrite, ItmFlush };
+const fault_sink_t fault_sink_rtt = { RttWrite, RttFlush };
+const fault_sink_t fault_sink_uart = { UartWrite, UartFlush };
+
+static char rttBuffer[FAULT_SINK_RTT_BUFFER_SIZE];
+
+fault_rtt_cb_t fault_rtt_cb = {
+	FAULT_SINK_RTT_ID,
+	1,
+	1,
+	{ { "Fault", rttBuffer, FAULT_SINK_RTT_BUFFER_SIZE, 0, 0, 0 } },
+	{ { "", 0, 0, 0, 0, 0 } },
+};
+
+static struct {
+	volatile uint32_t *dr;
+	volatile uint32_t *sr;
+	uint32_t txe;
+	uint32_t tc;
+} uart;
+
+
+/*
+ * Semihosting
+ */
+
+static uint32_t SemihostWrite(const void *buf, uint32_t len)
+{
+	return fwrite(buf, 1, len, stdout);
+}
+
+static void SemihostFlush(void)
+{
+	fflush(stdout);
+}
+
+
+/*
+ * ITM stimulus port 0
+ */
+
+/**
+ * \brief Send bytes through ITM port 0
+ *
+ * Bytes are dropped when trace is not enabled by a debugger, so the call
+ * never waits on a disconnected probe. Whole words go out with one store.
+ */
+static uint32_t ItmWrite(const void *buf, uint32_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t done = 0;
+	uint32_t spin;
+
+	if ((DEMCR & DEMCR_TRCENA) == 0 || (ITM_TCR & ITM_TCR_ITMENA) == 0 || (ITM_TER & 1) == 0) {
+		return len;
+	}
+
+	while (done < len) {
+		for (spin = 0; ITM_PORT32(0) == 0; spin++) {
+			if (spin >= FAULT_SINK_SPIN_LIMIT) {
+				return done;
+			}
+		}
+
+		if (len - done >= 4) {
+			ITM_PORT32(0) = (uint32_t)p[done] | ((uint32_t)p[done + 1] << 8) |
+			                ((uint32_t)p[done + 2] << 16) | ((uint32_t)p[done + 3] << 24);
+			done += 4;
+		} else {
+			ITM_PORT8(0) = p[done];
+			done++;
+		}
+	}
+
+	return done;
+}
+
+static void ItmFlush(void)
+{
+	/* The ITM FIFO drains on its own, the TPIU does not report completion */
+}
+
+
+/*
+ * RTT-style up-buffer
+ */
+
+/**
+ * \brief Copy bytes into the up-buffer
+ *
+ * Single producer, single consumer: the target only writes wr_off, the
+ * debugger only writes rd_off, so no lock is needed. When the buffer is full
+ * it waits a bounded time for the debugger to read, then drops the rest.
+ */
+static uint32_t RttWrite(const void *buf, uint32_t len)
+{
+	fault_rtt_buffer_t *up = &fault_rtt_cb.up[0];
+	const char *p = buf;
+	uint32_t done = 0;
+	uint32_t spin = 0;
+
+	while (done < len) {
+		uint32_t wr = up->wr_off;
+		uint32_t next = (wr + 1 == up->size) ? 0 : wr + 1;
+
+		if (next == up->rd_off) {
+			if (++spin >= FAULT_SINK_SPIN_LIMIT) {
+				break;
+			}
+			continue;
+		}
+
+		up->buffer[wr] = p[done++];
+		DMB();
+		up->wr_off = next;
+	}
+
+	return done;
+}
+
+/**
+ * \brief Wait a bounded time for the debugger to empty the up-buffer
+ */
+static void RttFlush(void)
+{
+	fault_rtt_buffer_t *up = &fault_rtt_cb.up[0];
+	uint32_t spin;
+
+	for (spin = 0; up->rd_off != up->wr_off && spin < FAULT_SINK_SPIN_LIMIT; spin++) {
+	}
+}
+
+
+/*
+ * Polled UART
+ */
+
+/**
+ * \brief Configure the polled UART sink
+ *
+ * The UART must already be clocked and configured by the application.
+ * For an STM32 USART pass &USARTx->DR, &USARTx->SR, 0x80 (TXE), 0x40 (TC).
+ *
+ * \param data_reg transmit data register
+ * \param status_reg status register
+ * \param tx_empty_mask status bit set when data_reg can take a byte
+ * \param tx_complete_mask status bit set when the last byte left the shifter
+ */
+void fault_sink_uart_init(volatile uint32_t *data_reg, volatile uint32_t *status_reg, uint32_t tx_empty_mask, uint32_t tx_complete_mask)
+{
+	uart.dr = data_reg;
+	uart.sr = status_reg;
+	uart.txe = tx_empty_mask;
+	uart.tc = tx_complete_mask;
+}
+
+static uint32_t UartWrite(const void *buf, uint32_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t done;
+	uint32_t spin;
+
+	if (uart.dr == 0) {
+		return 0;
+	}
+
+	for (done = 0; done < len; done++) {
+		for (spin = 0; (*uart.sr & uart.txe) == 0; spin++) {
+			if (spin >= FAULT_SINK_SPIN_LIMIT) {
+				return done;
+			}
+		}
+		*uart.dr = p[done];
+	}
+
+	return done;
+}
+
+static void UartFlush(void)
+{
+	uint32_t spin;
+
+	if (uart.sr == 0) {
+		return;
+	}
+
+	for (spin = 0; (*uart.sr & uart.tc) == 0 && spin < FAULT_SINK_SPIN_LIMIT; spin++) {
+	}
+}
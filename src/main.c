@@ -1,8 +1,47 @@
 #include "fault_handler.h"
 
+#if !FAULT_HANDLER_BENCH && !FAULT_HANDLER_SELFTEST
+
+#if FAULT_HANDLER_HOOKS > 0
+static void SafeState(const fault_record_t *rec)
+{
+   (void)rec;
+   /* drive outputs to their safe level: a few register writes */
+}
+#endif
+
 int main(void)
 {
+   fault_record_t rec;
+#if FAULT_HANDLER_PROBE
+   uint32_t word;
+#endif
+
+   if (fault_handler_boot_check() != 0) {
+      while (fault_handler_read_record(&rec)) {
+         /* send or log rec, the fault happened before this reset */
+      }
+   }
+
+#if FAULT_HANDLER_HOOKS > 0
+   /* runs right after the capture, before the slow text dump */
+   fault_handler_add_hook(SafeState, 0, 200);
+#endif
+
+   if (fault_handler_safe_mode()) {
+      /* crash loop: skip the heavy init, keep only what is needed to recover */
+   }
+
+#if FAULT_HANDLER_PROBE
+   /* same address as dangling_pointer2(), but returns false instead of crashing */
+   if (!fault_probe_read32(0x20200000UL, &word)) {
+      /* no RAM there on this part */
+   }
+#endif
+
    call_to_null_function();
    
    while(1);
 }
+
+#endif
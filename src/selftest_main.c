@@ -0,0 +1,169 @@
+/**
+ * \file
+ * \brief Fault injection self-test
+ *
+ * Built with FAULT_HANDLER_SELFTEST=1, main.c then drops out. Every test
+ * routine is run once in the same boot: the handler records and prints the
+ * fault, then redirects to a landing function that longjmps back here, and
+ * the record read back from the ring is checked against the CFSR causes the
+ * routine must raise. tools/qemu_selftest.sh runs it under QEMU.
+ *
+ * The faults are all recovered, so a second fault_handler_boot_check()
+ * run afterwards, standing for the next boot, must not report a crash loop.
+ *
+ * Output is one "selftest: PASS|FAIL|SKIP <routine> ..." line per routine
+ * and a final "selftest: <n> passed, <n> failed" line.
+ */
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fault_handler.h"
+
+#if FAULT_HANDLER_SELFTEST
+
+#if !FAULT_HANDLER_RECOVERY || FAULT_HANDLER_RESET_ON_FAULT || FAULT_HANDLER_BENCH
+#error The self-test needs FAULT_HANDLER_RECOVERY, without FAULT_HANDLER_RESET_ON_FAULT or FAULT_HANDLER_BENCH
+#endif
+
+#ifndef FAULT_SELFTEST_SINK
+#define FAULT_SELFTEST_SINK     fault_sink_semihost
+#endif
+
+/** All CFSR causes with a frame to return through */
+#define SELFTEST_CAUSES     0x030F0703UL
+
+#define CFSR_DACCVIOL       0x00000002UL
+#define CFSR_PRECISERR      0x00000200UL
+#define CFSR_IMPRECISERR    0x00000400UL
+#define CFSR_INVSTATE       0x00020000UL
+#define CFSR_DIVBYZERO      0x02000000UL
+
+#define DATA_FAULT          (CFSR_DACCVIOL | CFSR_PRECISERR | CFSR_IMPRECISERR)
+
+typedef struct {
+	const char *name;
+	uint32_t (*run)(void);
+	uint32_t expect;     /**< At least one of these CFSR bits must be set     */
+	bool may_not_fault;  /**< The address is backed by memory on some targets */
+} selftest_case_t;
+
+/*
+ * Private Functions
+ */
+static void SelftestLanding(void);
+static void Report(const char *verdict, const char *name, const fault_record_t *rec);
+static uint32_t RunBusFault(void);
+static uint32_t RunDivideByZero(void);
+static uint32_t RunNullFunction(void);
+static uint32_t RunDanglingPointer(void);
+static uint32_t RunDanglingPointer2(void);
+
+static const selftest_case_t cases[] = {
+	{ "bus_fault_code",        RunBusFault,         DATA_FAULT,     false },
+	{ "divide_by_zero",        RunDivideByZero,     CFSR_DIVBYZERO, false },
+	{ "call_to_null_function", RunNullFunction,     CFSR_INVSTATE,  false },
+	/* address 0x64 is RAM on mps2-an385 */
+	{ "dangling_pointer",      RunDanglingPointer,  DATA_FAULT,     true  },
+	/* 0x20200000 is inside the 4 MB SSRAM of mps2-an385 */
+	{ "dangling_pointer2",     RunDanglingPointer2, DATA_FAULT,     true  },
+};
+
+#define CASE_COUNT  (sizeof(cases) / sizeof(cases[0]))
+
+/* Statics, not locals: bus_fault_code() overwrites the stack above it */
+static jmp_buf selftestJmp;
+static volatile uint32_t current;
+static volatile uint32_t passed;
+static volatile uint32_t failed;
+static fault_record_t rec;
+
+
+int main(void)
+{
+	char line[64];
+
+	fault_handler_boot_check();
+	fault_handler_set_sink(&FAULT_SELFTEST_SINK);
+	fault_handler_set_policy(SELFTEST_CAUSES, FAULT_ACTION_REDIRECT, SelftestLanding);
+
+	for (current = 0; current < CASE_COUNT; current++) {
+		const selftest_case_t *c = &cases[current];
+		bool faulted = false;
+
+		if (setjmp(selftestJmp) == 0) {
+			c->run();
+		} else {
+			faulted = true;
+		}
+
+		/* keep the newest record, the ring only holds this case's fault */
+		memset(&rec, 0, sizeof(rec));
+		while (fault_handler_read_record(&rec)) {
+		}
+
+		if (!faulted || rec.magic != FAULT_RECORD_MAGIC) {
+			if (c->may_not_fault) {
+				Report("SKIP", c->name, 0);
+			} else {
+				Report("FAIL", c->name, 0);
+				failed++;
+			}
+		} else if ((rec.cfsr & c->expect) == 0 || rec.action != FAULT_ACTION_REDIRECT ||
+		           (FAULT_HANDLER_FULL_CONTEXT && (rec.flags & FAULT_FLAG_CONTEXT) == 0)) {
+			Report("FAIL", c->name, &rec);
+			failed++;
+		} else {
+			Report("PASS", c->name, &rec);
+			passed++;
+		}
+	}
+
+#if FAULT_HANDLER_LOOP_FAULTS > 0
+	/* the next boot: redirected faults are not a crash loop */
+	fault_handler_boot_check();
+	if (fault_handler_safe_mode()) {
+		failed++;
+	} else {
+		passed++;
+	}
+	snprintf(line, sizeof(line), "selftest: %s recovered_not_crash_loop\n", fault_handler_safe_mode() ? "FAIL" : "PASS");
+	fault_write(&FAULT_SELFTEST_SINK, line, strlen(line));
+#endif
+
+	snprintf(line, sizeof(line), "selftest: %u passed, %u failed\n", (unsigned)passed, (unsigned)failed);
+	fault_write(&FAULT_SELFTEST_SINK, line, strlen(line));
+	FAULT_SELFTEST_SINK.flush();
+
+	/* semihosting SYS_EXIT, QEMU stops here */
+	exit(failed == 0 ? 0 : 1);
+}
+
+/**
+ * \brief Redirect target of every injected fault, back to the case loop
+ */
+static void SelftestLanding(void)
+{
+	longjmp(selftestJmp, 1);
+}
+
+static void Report(const char *verdict, const char *name, const fault_record_t *r)
+{
+	char line[128];
+
+	if (r != 0) {
+		snprintf(line, sizeof(line), "selftest: %s %s cfsr=0x%08lx hfsr=0x%08lx pc=0x%08lx\n", verdict, name,
+		         (unsigned long)r->cfsr, (unsigned long)r->hfsr, (unsigned long)r->pc);
+	} else {
+		snprintf(line, sizeof(line), "selftest: %s %s no fault\n", verdict, name);
+	}
+	fault_write(&FAULT_SELFTEST_SINK, line, strlen(line));
+}
+
+static uint32_t RunBusFault(void)         { return bus_fault_code(); }
+static uint32_t RunDivideByZero(void)     { return divide_by_zero(); }
+static uint32_t RunNullFunction(void)     { return call_to_null_function(); }
+static uint32_t RunDanglingPointer(void)  { return dangling_pointer(); }
+static uint32_t RunDanglingPointer2(void) { return dangling_pointer2(); }
+
+#endif
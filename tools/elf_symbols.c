@@ -0,0 +1,182 @@
+/**
+ * \file
+ * \brief ELF32 function symbol index
+ *
+ * Loads the symbol table of a little-endian ARM ELF file once and answers
+ * address lookups with a binary search, so symbolizing a large batch of
+ * crash records never spawns addr2line.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "elf_symbols.h"
+
+#define SHT_SYMTAB  2
+#define STT_FUNC    2
+
+/*
+ * Private Functions
+ */
+static uint32_t Rd32(const char *p);
+static uint16_t Rd16(const char *p);
+static int CompareSymbols(const void *a, const void *b);
+
+
+/**
+ * \brief Build the function symbol index of an ELF file
+ *
+ * \return 0 on success, -1 if the file cannot be read or is not ELF32
+ */
+int elf_symbols_load(elf_symbols_t *index, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	long len;
+	uint32_t shoff, shentsize, shnum, i;
+
+	memset(index, 0, sizeof(*index));
+	if (f == NULL) {
+		return -1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	index->image = malloc(len > 0 ? len : 1);
+	if (index->image == NULL || len < 52 || fread(index->image, 1, len, f) != (size_t)len) {
+		fclose(f);
+		elf_symbols_free(index);
+		return -1;
+	}
+	fclose(f);
+
+	/* ELF magic, 32-bit, little endian */
+	if (memcmp(index->image, "\177ELF", 4) != 0 || index->image[4] != 1 || index->image[5] != 1) {
+		elf_symbols_free(index);
+		return -1;
+	}
+
+	shoff = Rd32(index->image + 32);
+	shentsize = Rd16(index->image + 46);
+	shnum = Rd16(index->image + 48);
+	if (shentsize < 40 || (uint64_t)shoff + (uint64_t)shentsize * shnum > (uint64_t)len) {
+		elf_symbols_free(index);
+		return -1;
+	}
+
+	for (i = 0; i < shnum; i++) {
+		const char *sh = index->image + shoff + i * shentsize;
+		uint32_t off, size, link, entsize, n, j;
+		uint32_t stroff, strsize;
+		const char *strtab;
+
+		if (Rd32(sh + 4) != SHT_SYMTAB) {
+			continue;
+		}
+
+		off = Rd32(sh + 16);
+		size = Rd32(sh + 20);
+		link = Rd32(sh + 24);
+		entsize = Rd32(sh + 36);
+		if (entsize < 16 || link >= shnum || (uint64_t)off + size > (uint64_t)len) {
+			break;
+		}
+		stroff = Rd32(index->image + shoff + link * shentsize + 16);
+		strsize = Rd32(index->image + shoff + link * shentsize + 20);
+		if ((uint64_t)stroff + strsize > (uint64_t)len || strsize == 0) {
+			break;
+		}
+		strtab = index->image + stroff;
+		/* names are used in place: the last one must end inside the section */
+		if (strtab[strsize - 1] != '\0') {
+			break;
+		}
+
+		n = size / entsize;
+		index->sym = malloc(n * sizeof(elf_symbol_t));
+		if (index->sym == NULL) {
+			break;
+		}
+
+		for (j = 0; j < n; j++) {
+			const char *s = index->image + off + j * entsize;
+			if ((s[12] & 0xF) != STT_FUNC || Rd16(s + 14) == 0 || Rd32(s) >= strsize) {
+				continue;
+			}
+			index->sym[index->count].addr = Rd32(s + 4) & ~1UL;
+			index->sym[index->count].size = Rd32(s + 8);
+			index->sym[index->count].name = strtab + Rd32(s);
+			index->count++;
+		}
+		break;
+	}
+
+	if (index->count == 0) {
+		elf_symbols_free(index);
+		return -1;
+	}
+
+	qsort(index->sym, index->count, sizeof(elf_symbol_t), CompareSymbols);
+	return 0;
+}
+
+/**
+ * \brief Find the function containing an address
+ *
+ * \param addr code address, the Thumb bit is ignored
+ * \return symbol, or NULL when the address is outside every function
+ */
+const elf_symbol_t *elf_symbols_find(const elf_symbols_t *index, uint32_t addr)
+{
+	uint32_t lo = 0, hi = index->count;
+	const elf_symbol_t *s;
+
+	addr &= ~1UL;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (index->sym[mid].addr <= addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo == 0) {
+		return NULL;
+	}
+
+	s = &index->sym[lo - 1];
+	if (s->size != 0 && addr - s->addr >= s->size) {
+		return NULL;
+	}
+	return s;
+}
+
+void elf_symbols_free(elf_symbols_t *index)
+{
+	free(index->sym);
+	free(index->image);
+	memset(index, 0, sizeof(*index));
+}
+
+static uint32_t Rd32(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+	return (uint32_t)u[0] | ((uint32_t)u[1] << 8) | ((uint32_t)u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+static uint16_t Rd16(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+	return (uint16_t)(u[0] | (u[1] << 8));
+}
+
+static int CompareSymbols(const void *a, const void *b)
+{
+	const elf_symbol_t *x = a, *y = b;
+
+	if (x->addr != y->addr) {
+		return (x->addr < y->addr) ? -1 : 1;
+	}
+	/* lookups take the last match: put the sized symbol last */
+	return (x->size < y->size) ? -1 : (x->size > y->size) ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+#ifndef __ELF_SYMBOLS_H_
+#define __ELF_SYMBOLS_H_
+
+#include <stdint.h>
+
+/**
+ * \brief One function symbol of the firmware image
+ */
+typedef struct {
+	uint32_t addr;      /**< Start address, Thumb bit cleared */
+	uint32_t size;      /**< Size in bytes, 0 if unknown      */
+	const char *name;   /**< Symbol name                      */
+} elf_symbol_t;
+
+/**
+ * \brief Address-sorted function symbol index of an ELF32 file
+ */
+typedef struct {
+	elf_symbol_t *sym;  /**< Symbols sorted by address        */
+	uint32_t count;     /**< Number of symbols                */
+	char *image;        /**< File contents, owns the names    */
+} elf_symbols_t;
+
+int elf_symbols_load(elf_symbols_t *index, const char *path);
+const elf_symbol_t *elf_symbols_find(const elf_symbols_t *index, uint32_t addr);
+void elf_symbols_free(elf_symbols_t *index);
+
+#endif
@@ -0,0 +1,522 @@
+/**
+ * \file
+ * \brief Host-side crash record decoder
+ *
+ * Reads binary crash records, raw or compact (fault_codec.h), as sent by a
+ * FAULT_HANDLER_NO_STRINGS build or dumped from the retained fault_ring,
+ * and prints the same text the
+ * handler prints on target. Records are found by their magic word, so a raw
+ * memory dump containing the ring header works too.
+ *
+ * For fleet data, pass a directory or a concatenated stream of records and
+ * the firmware ELF: the symbol index is built once and every pc/lr is
+ * resolved with a binary search. With -s only an aggregated report is
+ * printed, one line per distinct fault signature.
+ *
+ * An ELF core file sent by a FAULT_HANDLER_CORE build (fault_core.h) is
+ * skipped, records in its RAM included, and saved with -c for gdb; the
+ * second and later ones of a stream get .1, .2, ... appended.
+ *
+ * Build on the host with:
+ *
+ *     cc -O2 -Iinc -o fault_decoder tools/fault_decoder.c tools/elf_symbols.c src/fault_print.c src/fault_decode.c src/fault_codec.c src/fault_crc.c
+ *
+ * Usage: fault_decoder [-e firmware.elf] [-s] [-c core] [file|directory ...]
+ * Standard input is read when no file is given, or for "-".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fault_handler.h"
+#include "fault_decode.h"
+#include "fault_codec.h"
+#include "fault_crc.h"
+#include "fault_core.h"
+#include "elf_symbols.h"
+
+#define RECORD_WORDS    (sizeof(fault_record_t) / 4)
+#define ELF_MAGIC       0x464C457FUL  /**< "\177ELF" read little endian */
+
+/**
+ * \brief One line of the aggregated report
+ */
+typedef struct {
+	uint32_t used;      /**< Slot holds a signature        */
+	uint32_t func;      /**< Function address, or raw pc   */
+	uint32_t cfsr;      /**< CFSR                          */
+	uint32_t hfsr;      /**< HFSR                          */
+	uint32_t count;     /**< Faults with this signature    */
+	uint32_t pc;        /**< pc of the first record        */
+	uint32_t lr;        /**< lr of the first record        */
+} summary_t;
+
+/*
+ * Private Functions
+ */
+static uint32_t StdoutWrite(const void *buf, uint32_t len);
+static void StdoutFlush(void);
+static int DecodePath(const char *path);
+static int DecodeStream(FILE *f, const char *name);
+static void HandleRecord(const fault_record_t *rec);
+static size_t CoreLength(const uint8_t *p, size_t avail);
+static void SaveCore(const uint8_t *p, size_t len, size_t avail, const char *name, size_t pos);
+static void PrintSymbol(const char *label, uint32_t addr);
+static void Aggregate(const fault_record_t *rec);
+static void Report(void);
+static int CompareSummary(const void *a, const void *b);
+static uint32_t ReadLe32(const uint8_t *p);
+
+static const fault_sink_t stdoutSink = { StdoutWrite, StdoutFlush };
+
+/** Short CFSR bit names for the report, indexed by bit number */
+static const char * const cfsrNames[32] = {
+	"IACCVIOL", "DACCVIOL", 0, "MUNSTKERR", "MSTKERR", "MLSPERR", 0, "MMARVALID",
+	"IBUSERR", "PRECISERR", "IMPRECISERR", "UNSTKERR", "STKERR", "LSPERR", 0, "BFARVALID",
+	"UNDEFINSTR", "INVSTATE", "INVPC", "NOCP", "STKOF", 0, 0, 0,
+	"UNALIGNED", "DIVBYZERO", 0, 0, 0, 0, 0, 0,
+};
+
+static elf_symbols_t symbols;
+static int haveSymbols;
+static int summaryOnly;
+static unsigned long totalRecords;
+static const char *coreOut;
+static unsigned long totalCores;
+
+static summary_t *summary;
+static uint32_t summarySize;
+static uint32_t summaryUsed;
+
+
+int main(int argc, char *argv[])
+{
+	int opt, i, found = 0;
+
+	while ((opt = getopt(argc, argv, "e:sc:")) != -1) {
+		switch (opt) {
+		case 'e':
+			if (elf_symbols_load(&symbols, optarg) != 0) {
+				fprintf(stderr, "%s: no ELF32 symbol table\n", optarg);
+				return 2;
+			}
+			haveSymbols = 1;
+			break;
+		case 's':
+			summaryOnly = 1;
+			break;
+		case 'c':
+			coreOut = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-e firmware.elf] [-s] [-c core] [file|directory ...]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (optind >= argc) {
+		found = DecodeStream(stdin, "<stdin>");
+	}
+
+	for (i = optind; i < argc; i++) {
+		int n = DecodePath(argv[i]);
+		if (n < 0) {
+			return 2;
+		}
+		found += n;
+	}
+
+	if (summaryOnly) {
+		Report();
+	}
+
+	elf_symbols_free(&symbols);
+	free(summary);
+	return (found > 0) ? 0 : 1;
+}
+
+/**
+ * \brief Decode a file, a directory of files, or "-" for standard input
+ *
+ * \return number of records found, -1 on I/O error
+ */
+static int DecodePath(const char *path)
+{
+	struct stat st;
+	int found = 0;
+
+	if (strcmp(path, "-") == 0) {
+		return DecodeStream(stdin, "<stdin>");
+	}
+
+	if (stat(path, &st) != 0) {
+		perror(path);
+		return -1;
+	}
+
+	if (S_ISDIR(st.st_mode)) {
+		DIR *dir = opendir(path);
+		struct dirent *de;
+
+		if (dir == NULL) {
+			perror(path);
+			return -1;
+		}
+		while ((de = readdir(dir)) != NULL) {
+			char child[4096];
+			if (de->d_name[0] == '.') {
+				continue;
+			}
+			snprintf(child, sizeof(child), "%s/%s", path, de->d_name);
+			if (stat(child, &st) == 0 && S_ISREG(st.st_mode)) {
+				int n = DecodePath(child);
+				if (n > 0) {
+					found += n;
+				}
+			}
+		}
+		closedir(dir);
+		return found;
+	} else {
+		FILE *f = fopen(path, "rb");
+		if (f == NULL) {
+			perror(path);
+			return -1;
+		}
+		found = DecodeStream(f, path);
+		fclose(f);
+		return found;
+	}
+}
+
+/**
+ * \brief Decode every record of a stream
+ *
+ * Raw records are found by their magic word, compact ones by their sync
+ * bytes, and both must pass their CRC; core files are found by their ELF
+ * header; anything else is skipped a byte at a time.
+ *
+ * \return number of records found
+ */
+static int DecodeStream(FILE *f, const char *name)
+{
+	uint8_t *data = NULL;
+	size_t size = 0, cap = 0, pos = 0;
+	int found = 0;
+
+	for (;;) {
+		size_t n;
+		if (size == cap) {
+			uint8_t *p;
+			cap = (cap == 0) ? 65536 : cap * 2;
+			p = realloc(data, cap);
+			if (p == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(2);
+			}
+			data = p;
+		}
+		n = fread(data + size, 1, cap - size, f);
+		if (n == 0) {
+			break;
+		}
+		size += n;
+	}
+
+	while (pos + 4 <= size) {
+		fault_record_t rec;
+		uint32_t used;
+		size_t core;
+
+		if (ReadLe32(data + pos) == ELF_MAGIC && (core = CoreLength(data + pos, size - pos)) != 0) {
+			SaveCore(data + pos, core, size - pos, name, pos);
+			pos += (core < size - pos) ? core : size - pos;
+			continue;
+		}
+
+		if (size - pos >= sizeof(fault_record_t) && ReadLe32(data + pos) == FAULT_RECORD_MAGIC) {
+			uint32_t words[RECORD_WORDS];
+			size_t i;
+
+			for (i = 0; i < RECORD_WORDS; i++) {
+				words[i] = ReadLe32(data + pos + 4 * i);
+			}
+			memcpy(&rec, words, sizeof(rec));
+			used = sizeof(rec);
+#if FAULT_HANDLER_CRC
+			if (!fault_record_crc_ok(&rec)) {
+				fprintf(stderr, "%s: record at offset %lu fails its CRC, skipped\n", name, (unsigned long)pos);
+				pos += 4;
+				continue;
+			}
+#endif
+		} else if (!fault_record_decode(data + pos, (uint32_t)(size - pos), &rec, &used)) {
+			if (size - pos >= FAULT_CODEC_HEADER && data[pos] == FAULT_CODEC_SYNC0 &&
+			    data[pos + 1] == FAULT_CODEC_SYNC1) {
+				if (data[pos + 2] != FAULT_CODEC_VERSION) {
+					fprintf(stderr, "%s: compact record at offset %lu has version %u, this decoder reads %u\n",
+					        name, (unsigned long)pos, (unsigned)data[pos + 2], (unsigned)FAULT_CODEC_VERSION);
+				} else {
+					fprintf(stderr, "%s: compact record at offset %lu is cut or fails its CRC, skipped\n",
+					        name, (unsigned long)pos);
+				}
+			}
+			pos++;
+			continue;
+		}
+
+		HandleRecord(&rec);
+		found++;
+		pos += used;
+	}
+
+	free(data);
+
+	if (found == 0) {
+		fprintf(stderr, "%s: no crash record found\n", name);
+	}
+
+	return found;
+}
+
+/**
+ * \brief Length of the ELF core file at \p p, from its program headers
+ *
+ * \return 0 if \p p is not the start of an ARM core file; may be more than
+ * \p avail when the stream was cut
+ */
+static size_t CoreLength(const uint8_t *p, size_t avail)
+{
+	size_t end, i, phnum;
+
+	if (avail < FAULT_CORE_EHDR_SIZE || p[4] != 1 || p[5] != 1 ||
+	    (p[16] | p[17] << 8) != 4 || (p[18] | p[19] << 8) != 40 ||
+	    (p[42] | p[43] << 8) != FAULT_CORE_PHDR_SIZE) {
+		return 0;
+	}
+
+	phnum = p[44] | p[45] << 8;
+	end = ReadLe32(p + 28) + phnum * FAULT_CORE_PHDR_SIZE;
+	if (end > avail) {
+		return 0;
+	}
+	for (i = 0; i < phnum; i++) {
+		const uint8_t *ph = p + ReadLe32(p + 28) + i * FAULT_CORE_PHDR_SIZE;
+		size_t segEnd = (size_t)ReadLe32(ph + 4) + ReadLe32(ph + 16);
+
+		if (segEnd > end) {
+			end = segEnd;
+		}
+	}
+	return end;
+}
+
+/**
+ * \brief Write the core file at \p p to the -c file, or tell it was skipped
+ */
+static void SaveCore(const uint8_t *p, size_t len, size_t avail, const char *name, size_t pos)
+{
+	char path[4096];
+	FILE *f;
+
+	if (len > avail) {
+		fprintf(stderr, "%s: core file at offset %lu cut at %lu of %lu bytes\n", name,
+		        (unsigned long)pos, (unsigned long)avail, (unsigned long)len);
+		len = avail;
+	}
+	if (coreOut == NULL) {
+		fprintf(stderr, "%s: core file at offset %lu skipped, save it with -c\n", name, (unsigned long)pos);
+		return;
+	}
+
+	if (totalCores == 0) {
+		snprintf(path, sizeof(path), "%s", coreOut);
+	} else {
+		snprintf(path, sizeof(path), "%s.%lu", coreOut, totalCores);
+	}
+	totalCores++;
+
+	f = fopen(path, "wb");
+	if (f == NULL || fwrite(p, 1, len, f) != len) {
+		perror(path);
+	}
+	if (f != NULL) {
+		fclose(f);
+	}
+}
+
+/**
+ * \brief Print or aggregate one record
+ */
+static void HandleRecord(const fault_record_t *rec)
+{
+	if (summaryOnly) {
+		Aggregate(rec);
+		return;
+	}
+
+	if (totalRecords++ > 0) {
+		StdoutWrite("\n", 1);
+	}
+	fault_print_record(rec, &stdoutSink);
+
+	if (haveSymbols) {
+		PrintSymbol("pc ", rec->pc);
+		/* lr is a return address: look up the call instruction before it */
+		PrintSymbol("lr ", (rec->lr & ~1UL) - 1);
+#if FAULT_HANDLER_BACKTRACE_DEPTH > 0
+		{
+			uint32_t i;
+			for (i = 0; i < rec->backtrace_count && i < FAULT_HANDLER_BACKTRACE_DEPTH; i++) {
+				PrintSymbol("#  ", (rec->backtrace[i] & ~1UL) - 1);
+			}
+		}
+#endif
+	}
+}
+
+static void PrintSymbol(const char *label, uint32_t addr)
+{
+	const elf_symbol_t *s = elf_symbols_find(&symbols, addr);
+
+	if (s != NULL) {
+		printf("%s in %s+0x%x\n", label, s->name, (unsigned)((addr & ~1UL) - s->addr));
+	} else {
+		printf("%s in ??\n", label);
+	}
+}
+
+/**
+ * \brief Count a record under its (function, CFSR, HFSR) signature
+ *
+ * Open addressing hash table, doubled when half full.
+ */
+static void Aggregate(const fault_record_t *rec)
+{
+	const elf_symbol_t *s = haveSymbols ? elf_symbols_find(&symbols, rec->pc) : NULL;
+	uint32_t func = (s != NULL) ? s->addr : rec->pc;
+	uint32_t seen = (rec->count != 0) ? rec->count : 1; /* deduplicated repeats */
+	uint32_t h, i;
+
+	totalRecords++;
+
+	if (summaryUsed * 2 >= summarySize) {
+		summary_t *old = summary;
+		uint32_t oldSize = summarySize;
+
+		summarySize = (summarySize == 0) ? 1024 : summarySize * 2;
+		summary = calloc(summarySize, sizeof(summary_t));
+		if (summary == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+		summaryUsed = 0;
+		for (i = 0; i < oldSize; i++) {
+			if (old[i].used) {
+				uint32_t j = (old[i].func * 2654435761UL ^ old[i].cfsr ^ old[i].hfsr) & (summarySize - 1);
+				while (summary[j].used) {
+					j = (j + 1) & (summarySize - 1);
+				}
+				summary[j] = old[i];
+				summaryUsed++;
+			}
+		}
+		free(old);
+	}
+
+	h = (func * 2654435761UL ^ rec->cfsr ^ rec->hfsr) & (summarySize - 1);
+	while (summary[h].used) {
+		if (summary[h].func == func && summary[h].cfsr == rec->cfsr && summary[h].hfsr == rec->hfsr) {
+			summary[h].count += seen;
+			return;
+		}
+		h = (h + 1) & (summarySize - 1);
+	}
+
+	summary[h].used = 1;
+	summary[h].func = func;
+	summary[h].cfsr = rec->cfsr;
+	summary[h].hfsr = rec->hfsr;
+	summary[h].count = seen;
+	summary[h].pc = rec->pc;
+	summary[h].lr = rec->lr;
+	summaryUsed++;
+}
+
+/**
+ * \brief Print the aggregated signatures, most frequent first
+ */
+static void Report(void)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < summarySize; i++) {
+		if (summary[i].used) {
+			summary[n++] = summary[i];
+		}
+	}
+	qsort(summary, n, sizeof(summary_t), CompareSummary);
+
+	printf("%lu records, %u signatures\n", totalRecords, (unsigned)n);
+	printf("%8s  %-10s  %-10s  %-32s  %s\n", "count", "hfsr", "cfsr", "function", "causes");
+
+	for (i = 0; i < n; i++) {
+		const summary_t *e = &summary[i];
+		const elf_symbol_t *s = haveSymbols ? elf_symbols_find(&symbols, e->pc) : NULL;
+		char where[64];
+		uint32_t c;
+
+		if (s != NULL) {
+			snprintf(where, sizeof(where), "%s", s->name);
+		} else {
+			snprintf(where, sizeof(where), "0x%08x", (unsigned)e->pc);
+		}
+
+		printf("%8u  0x%08x  0x%08x  %-32s ", (unsigned)e->count, (unsigned)e->hfsr, (unsigned)e->cfsr, where);
+		/* causes in the order of the text dump */
+		for (c = 0; c < FAULT_CLASS_COUNT; c++) {
+			const fault_class_desc_t *desc = &fault_classes[c];
+			uint32_t bits = e->cfsr & desc->mask;
+			uint32_t k;
+
+			for (k = 0; bits != 0; k++) {
+				uint32_t bit = (desc->order != 0) ? desc->order[k] : fault_ctz(bits);
+				if ((bits & (1UL << bit)) == 0) {
+					continue;
+				}
+				if (cfsrNames[bit] != 0) {
+					printf(" %s", cfsrNames[bit]);
+				}
+				bits &= ~(1UL << bit);
+			}
+		}
+		printf("\n");
+	}
+}
+
+static int CompareSummary(const void *a, const void *b)
+{
+	const summary_t *x = a, *y = b;
+
+	if (x->count != y->count) {
+		return (x->count > y->count) ? -1 : 1;
+	}
+	return (x->func < y->func) ? -1 : (x->func > y->func) ? 1 : 0;
+}
+
+static uint32_t ReadLe32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t StdoutWrite(const void *buf, uint32_t len)
+{
+	return (uint32_t)fwrite(buf, 1, len, stdout);
+}
+
+static void StdoutFlush(void)
+{
+	fflush(stdout);
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Run FAULT_HANDLER_SELFTEST=1 firmware under QEMU and report the result.
+#
+# Usage: tools/qemu_selftest.sh firmware.elf[:machine] ...
+#
+# machine is mps2-an385 (default) or lm3s6965evb. Each ELF is built for one
+# board: the handler reads memory up to the configured bounds, so an image
+# built for the larger map faults on the smaller board. Build it with the
+# board startup code, --specs=rdimon.specs for semihosting, and the memory
+# map of the board:
+#
+#   mps2-an385:   -DFAULT_HANDLER_CODE_START=0 -DFAULT_HANDLER_CODE_END=0x400000
+#                 -DFAULT_HANDLER_RAM_END=0x20400000
+#   lm3s6965evb:  -DFAULT_HANDLER_CODE_START=0 -DFAULT_HANDLER_CODE_END=0x40000
+#                 -DFAULT_HANDLER_RAM_END=0x20010000
+#
+# e.g. tools/qemu_selftest.sh an385.elf:mps2-an385 lm3s.elf:lm3s6965evb
+#
+# Exit status is 0 when every run reports no failed case.
+
+QEMU=${QEMU:-qemu-system-arm}
+TIMEOUT=${TIMEOUT:-30}
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 firmware.elf[:machine] ..." >&2
+	exit 2
+fi
+
+status=0
+for run in "$@"; do
+	case $run in
+	*:*)	elf=${run%:*} machine=${run##*:} ;;
+	*)	elf=$run machine=mps2-an385 ;;
+	esac
+
+	log=$(timeout "$TIMEOUT" "$QEMU" -M "$machine" -nographic -monitor none -serial none \
+		-semihosting-config enable=on,target=native -kernel "$elf" 2>&1)
+
+	printf '%s\n' "$log" | grep '^selftest:' | sed "s/^/$machine /"
+
+	if ! printf '%s\n' "$log" | grep -q '^selftest: .* passed, 0 failed$'; then
+		echo "$machine: FAILED" >&2
+		status=1
+	fi
+done
+
+exit $status
@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# Build the handler in each configuration and report its flash and RAM cost.
+#
+# Usage: tools/size_report.sh [extra compiler flags ...]
+#
+# Extra flags apply to every configuration, e.g. the memory map of the part
+# or -DFAULT_HANDLER_FPU=1. Each configuration is linked with --gc-sections
+# from HardFault_Handler and the calls every application makes
+# (fault_handler_init, fault_handler_boot_check, fault_handler_read_record),
+# so the sizes are those of the final image: the C library parts the sinks
+# and the text output pull in are counted, and whatever a level does not
+# reach is dropped. RAM includes the retained ring and statistics.
+#
+# CC, SIZE and MCPU select the toolchain and core (arm-none-eabi-gcc,
+# arm-none-eabi-size, cortex-m4); ARCH_FLAGS replaces -mcpu/-mthumb and
+# LIBS the C library specs (newlib-nano without syscalls).
+
+CC=${CC:-arm-none-eabi-gcc}
+SIZE=${SIZE:-arm-none-eabi-size}
+MCPU=${MCPU:-cortex-m4}
+ARCH_FLAGS=${ARCH_FLAGS-"-mcpu=$MCPU -mthumb"}
+LIBS=${LIBS-"--specs=nano.specs --specs=nosys.specs"}
+ROOTS="-Wl,-e,HardFault_Handler -Wl,-u,fault_handler_init -Wl,-u,fault_handler_boot_check -Wl,-u,fault_handler_read_record"
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+srcs="fault_handler.c fault_arch_v6m.c fault_arch_v7m.c fault_print.c fault_decode.c fault_sink.c fault_codec.c fault_crc.c fault_core.c"
+out=$(mktemp -d) || exit 2
+trap 'rm -rf "$out"' EXIT
+
+printf '%-14s %8s %8s\n' config flash ram
+status=0
+
+# name and flags of each configuration, lightest last
+while read -r name flags; do
+	objs=
+	for src in $srcs; do
+		obj="$out/$name-${src%.c}.o"
+		# shellcheck disable=SC2086
+		if ! "$CC" $ARCH_FLAGS -Os -ffunction-sections -fdata-sections \
+			-I"$root/inc" $flags "$@" -c "$root/src/$src" -o "$obj"; then
+			echo "$name: build failed" >&2
+			status=1
+			continue 2
+		fi
+		objs="$objs $obj"
+	done
+	# shellcheck disable=SC2086
+	if ! "$CC" $ARCH_FLAGS $LIBS -nostartfiles -Wl,--gc-sections $ROOTS $objs -o "$out/$name.elf"; then
+		echo "$name: link failed" >&2
+		status=1
+		continue
+	fi
+	"$SIZE" "$out/$name.elf" | awk -v name="$name" 'NR == 2 { printf "%-14s %8d %8d\n", name, $1 + $2, $2 + $3 }'
+done <<EOF
+text            -DFAULT_HANDLER_LEVEL=FAULT_LEVEL_TEXT
+text-rtos       -DFAULT_HANDLER_LEVEL=FAULT_LEVEL_TEXT -DFAULT_HANDLER_RTOS=FAULT_RTOS_CUSTOM
+text-core       -DFAULT_HANDLER_LEVEL=FAULT_LEVEL_TEXT -DFAULT_HANDLER_CORE=1
+codes           -DFAULT_HANDLER_LEVEL=FAULT_LEVEL_CODES
+raw             -DFAULT_HANDLER_LEVEL=FAULT_LEVEL_RAW
+raw-compact     -DFAULT_HANDLER_LEVEL=FAULT_LEVEL_RAW -DFAULT_HANDLER_COMPACT=1
+capture         -DFAULT_HANDLER_LEVEL=FAULT_LEVEL_NONE
+capture-min     -DFAULT_HANDLER_LEVEL=FAULT_LEVEL_NONE -DFAULT_HANDLER_FULL_CONTEXT=0 -DFAULT_HANDLER_RING_SIZE=1 -DFAULT_HANDLER_BACKTRACE_DEPTH=0 -DFAULT_HANDLER_STACK_SNAPSHOT=0 -DFAULT_HANDLER_STATS=0 -DFAULT_HANDLER_DEDUP=0 -DFAULT_HANDLER_RECOVERY=0 -DFAULT_HANDLER_PROBE=0 -DFAULT_HANDLER_HOOKS=0 -DFAULT_HANDLER_CRC=0 -DFAULT_HANDLER_LOOP_FAULTS=0
+EOF
+
+exit $status